@@ -0,0 +1,254 @@
+#!/usr/bin/env python3
+#------------------------------------------------------------
+# weak and strong scaling driver for Amr101
+#
+# generates input decks from a base deck (inputs_for_scaling by
+# default), runs them with mpirun, and prints the parallel
+# efficiency and a per-phase breakdown taken from the telemetry
+# summary (amr.telemetry) and, if present, the TinyProfiler output.
+#
+#   $ python3 scaling_amr101.py -e ./main3d.gnu.MPI.ex -m strong -n 1 2 4 8
+#   $ python3 scaling_amr101.py -e ./main3d.gnu.MPI.ex -m weak -n 1 2 4 8 --save base.json
+#   $ python3 scaling_amr101.py -e ./main3d.gnu.MPI.ex -m weak -n 1 2 4 8 --compare base.json
+#   $ python3 scaling_amr101.py -e ./main3d.gnu.MPI.OMP.ex -m strong -n 1 2 4 -t 1 2 4 --max_grid_size 32 64
+#   $ python3 scaling_amr101.py -e ./main3d.gnu.MPI.ex -m weak -n 1 2 4 8 --scale_grid
+#------------------------------------------------------------
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+PHASES = ["advect", "fillpatch", "reflux", "average_down",
+          "regrid", "error_est", "compute_dt", "io"]
+
+
+def read_deck(fname):
+    """ordered list of (key, value) pairs, comments dropped"""
+    deck = []
+    with open(fname) as f:
+        for line in f:
+            line = line.split("#", 1)[0].strip()
+            if "=" not in line:
+                continue
+            key, val = line.split("=", 1)
+            deck.append((key.strip(), val.strip()))
+    return deck
+
+
+def write_deck(deck, overrides, fname):
+    """write deck with overrides; the last value of a key wins, as in ParmParse"""
+    with open(fname, "w") as f:
+        for key, val in deck:
+            if key not in overrides:
+                f.write("{} = {}\n".format(key, val))
+        for key, val in overrides.items():
+            f.write("{} = {}\n".format(key, val))
+
+
+def last_value(deck, key):
+    val = None
+    for k, v in deck:
+        if k == key:
+            val = v
+    return val
+
+
+def weak_n_cell(n_cell, scale):
+    """grow the domain by scale (a power of two), one direction at a time,
+    smallest direction first, so the cells per rank stay constant"""
+    n_cell = list(n_cell)
+    while scale > 1:
+        d = n_cell.index(min(n_cell))
+        n_cell[d] *= 2
+        scale //= 2
+    return n_cell
+
+
+def weak_max_grid_size(max_grid_size, n_cell, base_n_cell):
+    """max_grid_size in each direction grown with the domain, so the
+    number of grids stays the same as in the smallest run"""
+    return [max_grid_size * c // c0 for c, c0 in zip(n_cell, base_n_cell)]
+
+
+def parse_run(stdout, telemetry_file):
+    """total time, per-phase max times from the telemetry summary and the
+    exclusive TinyProfiler times"""
+    res = {"total": None, "phases": {}, "tiny": {}}
+
+    m = re.search(r"Total Time:\s*([0-9.eE+-]+)", stdout)
+    if m:
+        res["total"] = float(m.group(1))
+
+    if os.path.isfile(telemetry_file):
+        with open(telemetry_file) as f:
+            for line in f:
+                rec = json.loads(line)
+                if "summary" not in rec:
+                    continue
+                for lev in rec["summary"]["levels"]:
+                    for p in PHASES:
+                        # [min, avg, max] over ranks
+                        res["phases"][p] = res["phases"].get(p, 0.0) + lev[p][2]
+
+    # TinyProfiler exclusive table: name  ncalls  min  avg  max  max%
+    in_excl = False
+    for line in stdout.splitlines():
+        if line.startswith("TinyProfiler total time"):
+            in_excl = False
+        if "Excl." in line and "Min" in line:
+            in_excl = True
+            continue
+        if in_excl:
+            cols = line.split()
+            if len(cols) >= 6 and cols[1].isdigit():
+                try:
+                    res["tiny"][cols[0]] = float(cols[4])
+                except ValueError:
+                    pass
+    return res
+
+
+def run_key(res):
+    """runs are matched by rank count, threads and grid size"""
+    return (res["ranks"], res.get("threads", 1), res.get("max_grid_size"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Amr101 weak/strong scaling driver")
+    parser.add_argument("-e", "--exe", required=True, help="Amr101 executable")
+    parser.add_argument("-i", "--inputs", default="inputs_for_scaling", help="base input deck")
+    parser.add_argument("-m", "--mode", choices=["weak", "strong"], default="strong")
+    parser.add_argument("-n", "--ranks", type=int, nargs="+", default=[1, 2, 4, 8],
+                        help="MPI rank counts (powers of two for weak scaling)")
+    parser.add_argument("-t", "--threads", type=int, nargs="+", default=[1],
+                        help="OpenMP threads per rank, each count is swept over all rank counts")
+    parser.add_argument("--max_grid_size", type=int, nargs="+", default=[None],
+                        help="override amr.max_grid_size, each value is swept over all rank counts")
+    parser.add_argument("--scale_grid", action="store_true",
+                        help="weak scaling: grow max_grid_size with the domain instead of keeping it fixed")
+    parser.add_argument("--mpirun", default="mpirun -np {n}", help="launcher, {n} is the rank count")
+    parser.add_argument("-o", "--outdir", default="scaling", help="directory for decks and logs")
+    parser.add_argument("--save", help="write the results to this json file")
+    parser.add_argument("--compare", help="compare against results saved with --save")
+    parser.add_argument("--tol", type=float, default=0.10,
+                        help="relative slowdown reported as a regression")
+    args = parser.parse_args()
+
+    base = read_deck(args.inputs)
+    n_cell = [int(x) for x in last_value(base, "amr.n_cell").split()]
+    if args.scale_grid and args.mode != "weak":
+        sys.exit("--scale_grid only applies to weak scaling")
+
+    os.makedirs(args.outdir, exist_ok=True)
+    nmin = min(args.ranks)
+
+    results = []
+    for threads in args.threads:
+        for mgs in args.max_grid_size:
+            if args.scale_grid and mgs is None:
+                mgs = int(last_value(base, "amr.max_grid_size").split()[0])
+            sweep = []
+            for n in sorted(args.ranks):
+                name = "{}_n{}_t{}".format(args.mode, n, threads)
+                if mgs:
+                    name += "_g{}".format(mgs)
+                deck_file = os.path.join(args.outdir, "inputs_" + name)
+                telemetry_file = os.path.join(args.outdir, "telemetry_" + name + ".jsonl")
+
+                cells = weak_n_cell(n_cell, n // nmin) if args.mode == "weak" else n_cell
+                overrides = {"amr.n_cell": " ".join(str(c) for c in cells),
+                             "amr.plot_int": "-1",
+                             "amr.chk_int": "-1",
+                             "amr.telemetry": "1",
+                             "amr.telemetry_file": telemetry_file}
+                grid = None
+                if args.scale_grid:
+                    grid = weak_max_grid_size(mgs, cells, n_cell)
+                    for d, g in zip("xyz", grid):
+                        overrides["amr.max_grid_size_" + d] = str(g)
+                elif mgs:
+                    grid = [mgs] * len(cells)
+                    overrides["amr.max_grid_size"] = str(mgs)
+                write_deck(base, overrides, deck_file)
+
+                cmd = args.mpirun.format(n=n).split() + [args.exe, deck_file]
+                env = dict(os.environ, OMP_NUM_THREADS=str(threads))
+                print("running: " + " ".join(cmd))
+                proc = subprocess.run(cmd, env=env, stdout=subprocess.PIPE,
+                                      stderr=subprocess.STDOUT, universal_newlines=True)
+                with open(os.path.join(args.outdir, "log_" + name), "w") as f:
+                    f.write(proc.stdout)
+                if proc.returncode != 0:
+                    sys.exit("run {} failed, see {}".format(name, os.path.join(args.outdir, "log_" + name)))
+
+                res = parse_run(proc.stdout, telemetry_file)
+                res["ranks"] = n
+                res["threads"] = threads
+                res["max_grid_size"] = mgs
+                res["grid"] = grid
+                res["n_cell"] = cells
+                sweep.append(res)
+
+            # efficiency relative to the smallest run of this sweep
+            t0 = sweep[0]["total"]
+            n0 = sweep[0]["ranks"]
+            for res in sweep:
+                if res["total"]:
+                    if args.mode == "strong":
+                        res["efficiency"] = t0*n0 / (res["total"]*res["ranks"])
+                    else:
+                        res["efficiency"] = t0 / res["total"]
+                else:
+                    res["efficiency"] = None
+
+            title = "\n{} scaling, {} thread(s) per rank".format(args.mode, threads)
+            if mgs:
+                title += ", max_grid_size {}{}".format(mgs, " (scaled)" if args.scale_grid else "")
+            print(title)
+            hdr = "{:>6} {:>16} {:>16} {:>10} {:>8}".format("ranks", "n_cell", "max_grid", "time", "eff")
+            hdr += "".join(" {:>12}".format(p) for p in PHASES)
+            print(hdr)
+            for res in sweep:
+                line = "{:>6} {:>16} {:>16} {:>10.4g} {:>8.3f}".format(
+                    res["ranks"], "x".join(str(c) for c in res["n_cell"]),
+                    "x".join(str(g) for g in res["grid"]) if res["grid"] else "-",
+                    res["total"] or 0.0, res["efficiency"] or 0.0)
+                line += "".join(" {:>12.4g}".format(res["phases"].get(p, 0.0)) for p in PHASES)
+                print(line)
+            results += sweep
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump(results, f, indent=1)
+
+    if args.compare:
+        with open(args.compare) as f:
+            ref = {run_key(r): r for r in json.load(f)}
+        regressions = []
+        for res in results:
+            r = ref.get(run_key(res))
+            if r is None:
+                continue
+            label = "{} ranks, {} thread(s)".format(res["ranks"], res["threads"])
+            if res["max_grid_size"]:
+                label += ", max_grid_size {}".format(res["max_grid_size"])
+            for p in PHASES:
+                t, tr = res["phases"].get(p, 0.0), r["phases"].get(p, 0.0)
+                if tr > 0.0 and t > tr*(1.0 + args.tol):
+                    regressions.append("  {}: {} {:.4g} s -> {:.4g} s".format(label, p, tr, t))
+            if r.get("efficiency") and res["efficiency"] and \
+               res["efficiency"] < r["efficiency"]*(1.0 - args.tol):
+                regressions.append("  {}: efficiency {:.3f} -> {:.3f}".format(
+                    label, r["efficiency"], res["efficiency"]))
+        if regressions:
+            print("\nregressions (> {:.0f}%):".format(100*args.tol))
+            print("\n".join(regressions))
+            sys.exit(1)
+        print("\nno regressions against " + args.compare)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,5 +1,6 @@
 #include <AmrCoreAdv.H>
 #include <Kernels.H>
+#include <AdvectTile.H>
 
 #include <AMReX_MultiFabUtil.H>
 
@@ -24,9 +25,13 @@ AmrCoreAdv::AdvancePhiAllLevels (Real time, Real dt_lev, int iteration)
 
     for (int lev = 0; lev <= finest_level; lev++)
     {
-        std::swap(phi_old[lev], phi_new[lev]);
-        t_old[lev] = t_new[lev];
-        t_new[lev] += dt_lev;
+        // in lean mode phi is updated in place once the fluxes of all levels
+        // are computed from it, so the times only advance then
+        if (!lean) {
+            std::swap(phi_old[lev], phi_new[lev]);
+            t_old[lev] = t_new[lev];
+            t_new[lev] += dt_lev;
+        }
 
         const Real old_time = t_old[lev];
         const Real new_time = t_new[lev];
@@ -39,249 +44,85 @@ AmrCoreAdv::AdvancePhiAllLevels (Real time, Real dt_lev, int iteration)
 
         const Real* prob_lo = geom[lev].ProbLo();
 
+        TelemetryTimer tt(telemetry.get(), TelemetryPhase::Advect, lev);
+
+        const Real strt_time = amrex::second();
+
+        // With aggregation, touching boxes on the same rank are advanced as one
+        // larger box; the fluxes are copied back onto the level's own grids
+        const bool use_agg = UseAggregateGrids(lev);
+        const BoxArray& work_ba = use_agg ? agg_grids[lev] : grids[lev];
+        const DistributionMapping& work_dm = use_agg ? agg_dmap[lev] : dmap[lev];
+
+        Array<MultiFab, AMREX_SPACEDIM> vel_agg;
+        Array<MultiFab, AMREX_SPACEDIM> flux_agg;
+        if (use_agg)
+        {
+            for (int idim = 0; idim < AMREX_SPACEDIM; ++idim)
+            {
+                const BoxArray& fba = amrex::convert(work_ba, IntVect::TheDimensionVector(idim));
+                vel_agg[idim].define(fba, work_dm, 1, 1);
+                vel_agg[idim].ParallelCopy(facevel[lev][idim], 0, 0, 1, 1, 1);
+                flux_agg[idim].define(fba, work_dm, 1, 0);
+            }
+        }
+
+        Array<MultiFab, AMREX_SPACEDIM>& vel_work  = use_agg ? vel_agg  : facevel[lev];
+        Array<MultiFab, AMREX_SPACEDIM>& flux_work = use_agg ? flux_agg : fluxes[lev];
+
+        LayoutData<int> agg_props;
+        if (use_agg) {
+            classify_velocity(vel_agg, agg_props, 1);
+        }
+        const LayoutData<int>& props = use_agg ? agg_props : vel_props[lev];
+
         // State with ghost cells
-        MultiFab Sborder(grids[lev], dmap[lev], phi_new[lev].nComp(), num_grow);
+        MultiFab Sborder(work_ba, work_dm, phi_new[lev].nComp(), num_grow);
         FillPatch(lev, time, Sborder, 0, Sborder.nComp());
 
 #ifdef _OPENMP
 #pragma omp parallel if (Gpu::notInLaunchRegion())
 #endif
         {
-            for (MFIter mfi(phi_new[lev],TilingIfNotGPU()); mfi.isValid(); ++mfi)
+            for (MFIter mfi(Sborder,TilingIfNotGPU()); mfi.isValid(); ++mfi)
             {
-                GpuArray<Array4<Real>, AMREX_SPACEDIM> vel{ AMREX_D_DECL( facevel[lev][0].array(mfi),
-                                                                          facevel[lev][1].array(mfi),
-                                                                          facevel[lev][2].array(mfi)) };
-
                 const Box& bx = mfi.tilebox();
-                const Box& gbx = amrex::grow(bx, 1);
 
-                Array4<Real> statein  = Sborder.array(mfi);
-                Array4<Real> stateout = phi_new[lev].array(mfi);
-
-                GpuArray<Array4<Real>, AMREX_SPACEDIM> flux{ AMREX_D_DECL(fluxes[lev][0].array(mfi),
-                                                                          fluxes[lev][1].array(mfi),
-                                                                          fluxes[lev][2].array(mfi)) };
-    
-                    AMREX_D_TERM(const Box& dqbxx = amrex::grow(bx, IntVect{AMREX_D_DECL(2, 1, 1)});,
-                             const Box& dqbxy = amrex::grow(bx, IntVect{AMREX_D_DECL(1, 2, 1)});,
-                             const Box& dqbxz = amrex::grow(bx, IntVect{AMREX_D_DECL(1, 1, 2)}););
-
-                FArrayBox slope2fab (amrex::grow(bx, 2), 1);
-                Elixir slope2eli = slope2fab.elixir();
-                Array4<Real> slope2 = slope2fab.array();
-                FArrayBox slope4fab (amrex::grow(bx, 1), 1);
-                Elixir slope4eli = slope4fab.elixir();
-                Array4<Real> slope4 = slope4fab.array();
-    
-                // compute longitudinal fluxes
-                // ===========================
+                GpuArray<Array4<Real>, AMREX_SPACEDIM> vel;
+                Array<FArrayBox, AMREX_SPACEDIM> velfab;
+                Array<Elixir, AMREX_SPACEDIM> veleli;
+                if (lean) {
+                    LeanFaceVelocity(lev, bx, mfi.validbox(), psi_cache[lev][mfi], velfab);
+                    for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+                        veleli[idim] = velfab[idim].elixir();
+                        vel[idim] = velfab[idim].array();
+                    }
+                } else {
+                    for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+                        vel[idim] = vel_work[idim].array(mfi);
+                    }
+                }
 
-                // x -------------------------
-                FArrayBox phixfab (gbx, 1);
-                Elixir phixeli = phixfab.elixir();
-                Array4<Real> phix = phixfab.array();
-
-                amrex::launch(dqbxx,
-                [=] AMREX_GPU_DEVICE (const Box& tbx)
-                {
-                    slopex2(tbx, statein, slope2);
-                });
-
-                amrex::launch(gbx,
-                [=] AMREX_GPU_DEVICE (const Box& tbx)
-                {
-                    slopex4(tbx, statein, slope2, slope4);
-                });
-
-                amrex::ParallelFor(amrex::growLo(gbx, 0, -1),
-                [=] AMREX_GPU_DEVICE (int i, int j, int k)
-                {
-                    flux_x(i, j, k, statein, vel[0], phix, slope4, dtdx); 
-                });
-
-                // y -------------------------
-                FArrayBox phiyfab (gbx, 1);
-                Elixir phiyeli = phiyfab.elixir();
-                Array4<Real> phiy = phiyfab.array();
-
-                amrex::launch(dqbxy,
-                [=] AMREX_GPU_DEVICE (const Box& tbx)
-                {
-                    slopey2(tbx, statein, slope2);
-                });
-
-                amrex::launch(gbx,
-                [=] AMREX_GPU_DEVICE (const Box& tbx)
-                {
-                    slopey4(tbx, statein, slope2, slope4);
-                });
-
-                amrex::ParallelFor(amrex::growLo(gbx, 1, -1),
-                [=] AMREX_GPU_DEVICE (int i, int j, int k)
-                {
-                    flux_y(i, j, k, statein, vel[1], phiy, slope4, dtdx); 
-                });
-
-#if (AMREX_SPACEDIM > 2)
-                // z -------------------------
-                FArrayBox phizfab (gbx, 1);
-                Elixir phizeli = phizfab.elixir();
-                Array4<Real> phiz = phizfab.array();
-
-                amrex::launch(dqbxz,
-                [=] AMREX_GPU_DEVICE (const Box& tbx)
-                {
-                    slopez2(tbx, statein, slope2);
-                });
-
-                amrex::launch(gbx,
-                [=] AMREX_GPU_DEVICE (const Box& tbx)
-                {
-                    slopez4(tbx, statein, slope2, slope4);
-                });
-
-                amrex::ParallelFor(amrex::growLo(gbx, 2, -1),
-                [=] AMREX_GPU_DEVICE (int i, int j, int k)
-                {
-                    flux_z(i, j, k, statein, vel[2], phiz, slope4, dtdx); 
-                });
-
-                // compute transverse fluxes (3D only)
-                // ===================================
-
-                AMREX_D_TERM(const Box& gbxx = amrex::grow(bx, 0, 1);,
-                             const Box& gbxy = amrex::grow(bx, 1, 1);,
-                             const Box& gbxz = amrex::grow(bx, 2, 1););
-
-                // xy --------------------
-                FArrayBox phix_yfab (gbx, 1);
-                Elixir phix_yeli = phix_yfab.elixir();
-                Array4<Real> phix_y = phix_yfab.array();
-    
-                amrex::ParallelFor(amrex::growHi(gbxz, 0, 1),
-                [=] AMREX_GPU_DEVICE (int i, int j, int k)
-                {
-                    flux_xy(i, j, k, 
-                            AMREX_D_DECL(vel[0], vel[1], vel[2]),
-                            AMREX_D_DECL(phix, phiy, phiz),
-                            phix_y, dtdx);
-                }); 
-
-                // xz --------------------
-                FArrayBox phix_zfab (gbx, 1);
-                Elixir phix_zeli = phix_zfab.elixir();
-                Array4<Real> phix_z = phix_zfab.array();
-
-                amrex::ParallelFor(amrex::growHi(gbxy, 0, 1),
-                [=] AMREX_GPU_DEVICE (int i, int j, int k)
-                {
-                    flux_xz(i, j, k,
-                            AMREX_D_DECL(vel[0], vel[1], vel[2]),
-                            AMREX_D_DECL(phix, phiy, phiz),
-                            phix_z, dtdx);
-                }); 
-
-                // yx --------------------
-                FArrayBox phiy_xfab (gbx, 1);
-                FArrayBox phiy_zfab (gbx, 1);
-                Elixir phiy_xeli = phiy_xfab.elixir();
-                Elixir phiy_zeli = phiy_zfab.elixir();
-                Array4<Real> phiy_x = phiy_xfab.array();
-                Array4<Real> phiy_z = phiy_zfab.array();
-
-                amrex::ParallelFor(amrex::growHi(gbxz, 1, 1),
-                [=] AMREX_GPU_DEVICE (int i, int j, int k)
-                {
-                    flux_yx(i, j, k,
-                            AMREX_D_DECL(vel[0], vel[1], vel[2]),
-                            AMREX_D_DECL(phix, phiy, phiz),
-                            phiy_x, dtdx);
-                }); 
-
-                // yz --------------------
-                amrex::ParallelFor(amrex::growHi(gbxx, 1, 1),
-                [=] AMREX_GPU_DEVICE (int i, int j, int k)
-                {
-                    flux_yz(i, j, k,
-                            AMREX_D_DECL(vel[0], vel[1], vel[2]),
-                            AMREX_D_DECL(phix, phiy, phiz),
-                            phiy_z, dtdx);
-                }); 
+                Array4<Real> statein  = Sborder.array(mfi);
 
-                // zx & zy --------------------
-                FArrayBox phiz_xfab (gbx, 1);
-                FArrayBox phiz_yfab (gbx, 1);
-                Elixir phiz_xeli = phiz_xfab.elixir();
-                Elixir phiz_yeli = phiz_yfab.elixir();
-                Array4<Real> phiz_x = phiz_xfab.array();
-                Array4<Real> phiz_y = phiz_yfab.array();
+                GpuArray<Array4<Real>, AMREX_SPACEDIM> flux{ AMREX_D_DECL(flux_work[0].array(mfi),
+                                                                          flux_work[1].array(mfi),
+                                                                          flux_work[2].array(mfi)) };
     
-                amrex::ParallelFor(amrex::growHi(gbxy, 2, 1),
-                [=] AMREX_GPU_DEVICE (int i, int j, int k)
-                {
-                    flux_zx(i, j, k, 
-                            AMREX_D_DECL(vel[0], vel[1], vel[2]),
-                            AMREX_D_DECL(phix, phiy, phiz),
-                            phiz_x, dtdx);
-                }); 
-
-                amrex::ParallelFor(amrex::growHi(gbxx, 2, 1),
-                [=] AMREX_GPU_DEVICE (int i, int j, int k)
-                {
-                    flux_zy(i, j, k,
-                            AMREX_D_DECL(vel[0], vel[1], vel[2]),
-                            AMREX_D_DECL(phix, phiy, phiz),
-                            phiz_y, dtdx);
-                }); 
-#endif
+                compute_flux_tile(bx, statein, vel, flux, dtdx, props[mfi]);
+            } // end mfi
+        } // end omp
 
-                // final edge states 
-                // ===========================
-                amrex::ParallelFor(amrex::growHi(bx, 0, 1),
-                [=] AMREX_GPU_DEVICE (int i, int j, int k)
-                {
-                    create_flux_x(i, j, k,
-                                  vel[0], vel[1], 
-#if (AMREX_SPACEDIM > 2)
-                                  vel[2],
-#endif
-#if (AMREX_SPACEDIM > 2)
-                                  phix, phiy_z, phiz_y,
-#else
-                                  phix, phiy,
-#endif
-                                  flux[0], dtdx);
-                });
+        RecordLevelMemory(lev, Sborder, flux_work);
 
-                amrex::ParallelFor(amrex::growHi(bx, 1, 1),
-                [=] AMREX_GPU_DEVICE (int i, int j, int k)
-                {
-                    create_flux_y(i, j, k,
-                                  vel[0], vel[1], 
-#if (AMREX_SPACEDIM > 2)
-                                  vel[2],
-#endif
-#if (AMREX_SPACEDIM > 2)
-                                  phiy, phix_z, phiz_x,
-#else
-                                  phiy, phix,
-#endif
-                                  flux[1], dtdx);
-            });
+        if (use_agg) {
+            for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+                fluxes[lev][idim].ParallelCopy(flux_agg[idim], 0, 0, 1);
+            }
+        }
 
-#if (AMREX_SPACEDIM > 2)
-            amrex::ParallelFor(amrex::growHi(bx, 2, 1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                create_flux_z(i, j, k,
-                               vel[0], vel[1], vel[2],
-                               phiz, phix_y, phiy_x,
-                               flux[2], dtdx);
-            });
-#endif
-            } // end mfi
-        } // end omp
+        advance_time[lev] += amrex::second() - strt_time;
+        advance_cells[lev] += CountCells(lev);
     } // end lev
 
     // =======================================================
@@ -289,6 +130,7 @@ AmrCoreAdv::AdvancePhiAllLevels (Real time, Real dt_lev, int iteration)
     // =======================================================
     for (int lev = finest_level; lev > 0; lev--)
     {
+       TelemetryTimer tt(telemetry.get(), TelemetryPhase::AverageDown, lev);
        average_down_faces(amrex::GetArrOfConstPtrs(fluxes[lev  ]),
                           amrex::GetArrOfPtrs     (fluxes[lev-1]),
                           refRatio(lev-1), Geom(lev-1));
@@ -296,6 +138,15 @@ AmrCoreAdv::AdvancePhiAllLevels (Real time, Real dt_lev, int iteration)
 
     for (int lev = 0; lev <= finest_level; lev++)
     {
+        TelemetryTimer tt(telemetry.get(), TelemetryPhase::Advect, lev);
+
+        if (lean) {
+            t_old[lev] = t_new[lev];
+            t_new[lev] += dt_lev;
+        }
+
+        // in lean mode each cell reads its own old value before overwriting it
+        MultiFab& S_old = lean ? phi_new[lev] : phi_old[lev];
 
 #ifdef _OPENMP
 #pragma omp parallel if (Gpu::notInLaunchRegion())
@@ -311,7 +162,7 @@ AmrCoreAdv::AdvancePhiAllLevels (Real time, Real dt_lev, int iteration)
             // ===========================================
             for (MFIter mfi(phi_new[lev],TilingIfNotGPU()); mfi.isValid(); ++mfi)
             {
-                Array4<Real> statein  = phi_old[lev].array(mfi);
+                Array4<Real> statein  = S_old.array(mfi);
                 Array4<Real> stateout = phi_new[lev].array(mfi);
 
                 GpuArray<Array4<Real>, AMREX_SPACEDIM> flux{ AMREX_D_DECL(fluxes[lev][0].array(mfi),
@@ -1,5 +1,6 @@
 #include <AmrCoreAdv.H>
 #include <Kernels.H>
+#include <AdvectTile.H>
 
 using namespace amrex;
 
@@ -9,6 +10,10 @@ AmrCoreAdv::AdvancePhiAtLevel (int lev, Real time, Real dt_lev, int iteration, i
 {
     constexpr int num_grow = 3;
 
+    TelemetryTimer tt(telemetry.get(), TelemetryPhase::Advect, lev);
+
+    const Real strt_time = amrex::second();
+
     std::swap(phi_old[lev], phi_new[lev]);
 
     MultiFab& S_new = phi_new[lev];
@@ -37,22 +42,50 @@ AmrCoreAdv::AdvancePhiAtLevel (int lev, Real time, Real dt_lev, int iteration, i
         }
     }
 
+    // With aggregation, touching boxes on the same rank are advanced as one
+    // larger box, so the cells along their shared faces are not ghost cells.
+    // The result is copied back into phi_new; those copies stay on-rank.
+    const bool use_agg = UseAggregateGrids(lev);
+    const BoxArray& work_ba = use_agg ? agg_grids[lev] : grids[lev];
+    const DistributionMapping& work_dm = use_agg ? agg_dmap[lev] : dmap[lev];
+
+    MultiFab S_agg;
+    Array<MultiFab, AMREX_SPACEDIM> vel_agg;
+    if (use_agg)
+    {
+        S_agg.define(work_ba, work_dm, S_new.nComp(), 0);
+        for (int idim = 0; idim < AMREX_SPACEDIM; ++idim)
+        {
+            vel_agg[idim].define(amrex::convert(work_ba, IntVect::TheDimensionVector(idim)), work_dm, 1, 1);
+            vel_agg[idim].ParallelCopy(facevel[lev][idim], 0, 0, 1, 1, 1);
+        }
+    }
+
+    MultiFab& S_work = use_agg ? S_agg : S_new;
+    Array<MultiFab, AMREX_SPACEDIM>& vel_work = use_agg ? vel_agg : facevel[lev];
+
+    LayoutData<int> agg_props;
+    if (use_agg) {
+        classify_velocity(vel_agg, agg_props, 1);
+    }
+    const LayoutData<int>& props = use_agg ? agg_props : vel_props[lev];
+
     // State with ghost cells
-    MultiFab Sborder(grids[lev], dmap[lev], S_new.nComp(), num_grow);
+    MultiFab Sborder(work_ba, work_dm, S_new.nComp(), num_grow);
     FillPatch(lev, time, Sborder, 0, Sborder.nComp());
 
     // Build temporary multiFabs to work on.
     Array<MultiFab, AMREX_SPACEDIM> fluxcalc;
     for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
-        BoxArray ba = amrex::convert(S_new.boxArray(), IntVect::TheDimensionVector(idim));
-        fluxcalc[idim].define (ba,S_new.DistributionMap(), S_new.nComp(), 0);
+        BoxArray ba = amrex::convert(S_work.boxArray(), IntVect::TheDimensionVector(idim));
+        fluxcalc[idim].define (ba,S_work.DistributionMap(), S_new.nComp(), 0);
     }
 
 #ifdef _OPENMP
 #pragma omp parallel if (Gpu::notInLaunchRegion())
 #endif
     {
-	for (MFIter mfi(S_new,TilingIfNotGPU()); mfi.isValid(); ++mfi)
+	for (MFIter mfi(S_work,TilingIfNotGPU()); mfi.isValid(); ++mfi)
 	{
 
         // ======== GET FACE VELOCITY =========
@@ -65,238 +98,22 @@ AmrCoreAdv::AdvancePhiAtLevel (int lev, Real time, Real dt_lev, int iteration, i
                          const Box& ngbxy = amrex::grow(mfi.nodaltilebox(1),1);,
                          const Box& ngbxz = amrex::grow(mfi.nodaltilebox(2),1););
 
-            GpuArray<Array4<Real>, AMREX_SPACEDIM> vel{ AMREX_D_DECL( facevel[lev][0].array(mfi),
-                                                                      facevel[lev][1].array(mfi),
-                                                                      facevel[lev][2].array(mfi)) };
+            GpuArray<Array4<Real>, AMREX_SPACEDIM> vel{ AMREX_D_DECL( vel_work[0].array(mfi),
+                                                                      vel_work[1].array(mfi),
+                                                                      vel_work[2].array(mfi)) };
 
         // ======== FLUX CALC AND UPDATE =========
 
 	    const Box& bx = mfi.tilebox();
-            const Box& gbx = amrex::grow(bx, 1);
 
             Array4<Real> statein  = Sborder.array(mfi);
-            Array4<Real> stateout = S_new.array(mfi);
+            Array4<Real> stateout = S_work.array(mfi);
 
             GpuArray<Array4<Real>, AMREX_SPACEDIM> flux{ AMREX_D_DECL(fluxcalc[0].array(mfi),
                                                                       fluxcalc[1].array(mfi),
                                                                       fluxcalc[2].array(mfi)) };
 
-            AMREX_D_TERM(const Box& dqbxx = amrex::grow(bx, IntVect{AMREX_D_DECL(2, 1, 1)});,
-                         const Box& dqbxy = amrex::grow(bx, IntVect{AMREX_D_DECL(1, 2, 1)});,
-                         const Box& dqbxz = amrex::grow(bx, IntVect{AMREX_D_DECL(1, 1, 2)}););
-
-            FArrayBox slope2fab (amrex::grow(bx, 2), 1);
-            Elixir slope2eli = slope2fab.elixir();
-            Array4<Real> slope2 = slope2fab.array();
-            FArrayBox slope4fab (amrex::grow(bx, 1), 1);
-            Elixir slope4eli = slope4fab.elixir();
-            Array4<Real> slope4 = slope4fab.array();
-
-            // compute longitudinal fluxes
-            // ===========================
-
-            // x -------------------------
-            FArrayBox phixfab (gbx, 1);
-            Elixir phixeli = phixfab.elixir();
-            Array4<Real> phix = phixfab.array();
-
-            amrex::launch(dqbxx,
-            [=] AMREX_GPU_DEVICE (const Box& tbx)
-            {
-                slopex2(tbx, statein, slope2);
-            });
-
-            amrex::launch(gbx,
-            [=] AMREX_GPU_DEVICE (const Box& tbx)
-            {
-                slopex4(tbx, statein, slope2, slope4);
-            });
-
-            amrex::ParallelFor(amrex::growLo(gbx, 0, -1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                flux_x(i, j, k, statein, vel[0], phix, slope4, dtdx); 
-            });
-
-
-            // y -------------------------
-            FArrayBox phiyfab (gbx, 1);
-            Elixir phiyeli = phiyfab.elixir();
-            Array4<Real> phiy = phiyfab.array();
-
-            amrex::launch(dqbxy,
-            [=] AMREX_GPU_DEVICE (const Box& tbx)
-            {
-                slopey2(tbx, statein, slope2);
-            });
-
-            amrex::launch(gbx,
-            [=] AMREX_GPU_DEVICE (const Box& tbx)
-            {
-                slopey4(tbx, statein, slope2, slope4);
-            });
-
-            amrex::ParallelFor(amrex::growLo(gbx, 1, -1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                flux_y(i, j, k, statein, vel[1], phiy, slope4, dtdx); 
-            });
-
-#if (AMREX_SPACEDIM > 2)
-            // z -------------------------
-            FArrayBox phizfab (gbx, 1);
-            Elixir phizeli = phizfab.elixir();
-            Array4<Real> phiz = phizfab.array();
-
-            amrex::launch(dqbxz,
-            [=] AMREX_GPU_DEVICE (const Box& tbx)
-            {
-                slopez2(tbx, statein, slope2);
-            });
-
-            amrex::launch(gbx,
-            [=] AMREX_GPU_DEVICE (const Box& tbx)
-            {
-                slopez4(tbx, statein, slope2, slope4);
-            });
-
-            amrex::ParallelFor(amrex::growLo(gbx, 2, -1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                flux_z(i, j, k, statein, vel[2], phiz, slope4, dtdx); 
-            });
-
-            // compute transverse fluxes (3D only)
-            // ===================================
-
-            AMREX_D_TERM(const Box& gbxx = amrex::grow(bx, 0, 1);,
-                         const Box& gbxy = amrex::grow(bx, 1, 1);,
-                         const Box& gbxz = amrex::grow(bx, 2, 1););
-
-            // xy --------------------
-            FArrayBox phix_yfab (gbx, 1);
-            Elixir phix_yeli = phix_yfab.elixir();
-            Array4<Real> phix_y = phix_yfab.array();
-
-            amrex::ParallelFor(amrex::growHi(gbxz, 0, 1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                flux_xy(i, j, k, 
-                        AMREX_D_DECL(vel[0], vel[1], vel[2]),
-                        AMREX_D_DECL(phix, phiy, phiz),
-                        phix_y, dtdx);
-            }); 
-
-            // xz --------------------
-            FArrayBox phix_zfab (gbx, 1);
-            Elixir phix_zeli = phix_zfab.elixir();
-            Array4<Real> phix_z = phix_zfab.array();
-
-            amrex::ParallelFor(amrex::growHi(gbxy, 0, 1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                flux_xz(i, j, k,
-                        AMREX_D_DECL(vel[0], vel[1], vel[2]),
-                        AMREX_D_DECL(phix, phiy, phiz),
-                        phix_z, dtdx);
-            }); 
-
-            // yx --------------------
-            FArrayBox phiy_xfab (gbx, 1);
-            FArrayBox phiy_zfab (gbx, 1);
-            Elixir phiy_xeli = phiy_xfab.elixir();
-            Elixir phiy_zeli = phiy_zfab.elixir();
-            Array4<Real> phiy_x = phiy_xfab.array();
-            Array4<Real> phiy_z = phiy_zfab.array();
-
-            amrex::ParallelFor(amrex::growHi(gbxz, 1, 1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                flux_yx(i, j, k,
-                        AMREX_D_DECL(vel[0], vel[1], vel[2]),
-                        AMREX_D_DECL(phix, phiy, phiz),
-                        phiy_x, dtdx);
-            }); 
-
-            // yz --------------------
-            amrex::ParallelFor(amrex::growHi(gbxx, 1, 1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                flux_yz(i, j, k,
-                        AMREX_D_DECL(vel[0], vel[1], vel[2]),
-                        AMREX_D_DECL(phix, phiy, phiz),
-                        phiy_z, dtdx);
-            }); 
-
-            // zx & zy --------------------
-            FArrayBox phiz_xfab (gbx, 1);
-            FArrayBox phiz_yfab (gbx, 1);
-            Elixir phiz_xeli = phiz_xfab.elixir();
-            Elixir phiz_yeli = phiz_yfab.elixir();
-            Array4<Real> phiz_x = phiz_xfab.array();
-            Array4<Real> phiz_y = phiz_yfab.array();
-
-            amrex::ParallelFor(amrex::growHi(gbxy, 2, 1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                flux_zx(i, j, k, 
-                        AMREX_D_DECL(vel[0], vel[1], vel[2]),
-                        AMREX_D_DECL(phix, phiy, phiz),
-                        phiz_x, dtdx);
-            }); 
-
-            amrex::ParallelFor(amrex::growHi(gbxx, 2, 1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                flux_zy(i, j, k,
-                        AMREX_D_DECL(vel[0], vel[1], vel[2]),
-                        AMREX_D_DECL(phix, phiy, phiz),
-                        phiz_y, dtdx);
-            }); 
-#endif
-
-            // final edge states 
-            // ===========================
-            amrex::ParallelFor(amrex::growHi(bx, 0, 1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                create_flux_x(i, j, k,
-                              vel[0], vel[1], 
-#if (AMREX_SPACEDIM > 2)
-                              vel[2],
-                              phix, phiy_z, phiz_y,
-#else
-                              phix, phiy,
-#endif
-                              flux[0], dtdx);
-            });
-
-            amrex::ParallelFor(amrex::growHi(bx, 1, 1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                create_flux_y(i, j, k,
-                              vel[0], vel[1], 
-#if (AMREX_SPACEDIM > 2)
-                              vel[2],
-#endif
-#if (AMREX_SPACEDIM > 2)
-                              phiy, phix_z, phiz_x,
-#else
-                              phiy, phix,
-#endif
-                              flux[1], dtdx);
-            });
-
-#if (AMREX_SPACEDIM > 2)
-            amrex::ParallelFor(amrex::growHi(bx, 2, 1),
-            [=] AMREX_GPU_DEVICE (int i, int j, int k)
-            {
-                create_flux_z(i, j, k,
-                               vel[0], vel[1], vel[2],
-                               phiz, phix_y, phiy_x,
-                               flux[2], dtdx);
-            });
-#endif
+            compute_flux_tile(bx, statein, vel, flux, dtdx, props[mfi]);
 
             // compute new state (stateout) and scale fluxes based on face area.
             // ===========================
@@ -332,7 +149,7 @@ AmrCoreAdv::AdvancePhiAtLevel (int lev, Real time, Real dt_lev, int iteration, i
                          });
                         );
 
-            if (do_reflux) {
+            if (do_reflux && !use_agg) {
 
                 GpuArray<Array4<Real>, AMREX_SPACEDIM> fluxout{ AMREX_D_DECL(fluxes[0].array(mfi),
                                                                              fluxes[1].array(mfi),
@@ -349,11 +166,28 @@ AmrCoreAdv::AdvancePhiAtLevel (int lev, Real time, Real dt_lev, int iteration, i
         }
     }
 
+    RecordLevelMemory(lev, Sborder, fluxcalc);
+
+    if (use_agg)
+    {
+        S_new.ParallelCopy(S_agg, 0, 0, S_new.nComp());
+        if (do_reflux) {
+            for (int i = 0; i < AMREX_SPACEDIM; ++i) {
+                fluxes[i].ParallelCopy(fluxcalc[i], 0, 0, fluxes[i].nComp());
+            }
+        }
+    }
+
+    advance_time[lev] += amrex::second() - strt_time;
+    advance_cells[lev] += CountCells(lev);
+
     // ======== CFL CHECK, MOVED OUTSIDE MFITER LOOP =========
 
-    AMREX_D_TERM(Real umax = facevel[lev][0].norm0(0,0,false);,
-                 Real vmax = facevel[lev][1].norm0(0,0,false);,
-                 Real wmax = facevel[lev][2].norm0(0,0,false););
+    // components known to be zero on the whole level need no reduction
+    const int lprops = vel_level_props[lev];
+    AMREX_D_TERM(Real umax = has_vel_prop(lprops,0,vel_zero) ? 0.0 : MaxFaceVelocity(lev,0,false);,
+                 Real vmax = has_vel_prop(lprops,1,vel_zero) ? 0.0 : MaxFaceVelocity(lev,1,false);,
+                 Real wmax = has_vel_prop(lprops,2,vel_zero) ? 0.0 : MaxFaceVelocity(lev,2,false););
 
     if (AMREX_D_TERM(umax*dt_lev > dx[0], ||
                      vmax*dt_lev > dx[1], ||
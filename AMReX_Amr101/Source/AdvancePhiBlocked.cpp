@@ -0,0 +1,219 @@
+#include <AmrCoreAdv.H>
+#include <Kernels.H>
+#include <AdvectTile.H>
+
+using namespace amrex;
+
+// Temporal blocking on level 0: fill num_grow*nblock ghost cells once, then
+// advance nblock steps without communication. Each step computes the update on
+// a region num_grow cells smaller than the last, redundantly recomputing the
+// cells that neighboring boxes also own, so only the valid region is left after
+// the last step.
+//
+// Only used when level 0 is the finest level and the domain is fully periodic,
+// so that the redundant updates of ghost cells are exact.
+void
+AmrCoreAdv::AdvancePhiBlocked (Real time, Real dt_lev, int nblock)
+{
+    constexpr int num_grow = 3;
+
+    const int lev = 0;
+    const int ng  = num_grow*nblock;
+
+    TelemetryTimer tt(telemetry.get(), TelemetryPhase::Advect, lev);
+
+    std::swap(phi_old[lev], phi_new[lev]);
+
+    const int ncomp = phi_new[lev].nComp();
+
+    const auto dx = geom[lev].CellSizeArray();
+    GpuArray<Real, AMREX_SPACEDIM> dtdx;
+    for (int i=0; i<AMREX_SPACEDIM; ++i)
+    {
+        dtdx[i] = dt_lev/(dx[i]);
+    }
+
+    // one deep ghost cell exchange for all nblock steps
+    Real strt_time = amrex::second();
+
+    MultiFab Sa(grids[lev], dmap[lev], ncomp, ng);
+    MultiFab Sb(grids[lev], dmap[lev], ncomp, ng);
+    FillPatch(lev, time, Sa, 0, ncomp);
+
+    const Real fill_time = amrex::second() - strt_time;
+
+    strt_time = amrex::second();
+
+    // the face velocities and fluxes are needed on the grown region of the first step
+    Array<MultiFab, AMREX_SPACEDIM> vel;
+    Array<MultiFab, AMREX_SPACEDIM> fluxcalc;
+    for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+        BoxArray ba = amrex::convert(grids[lev], IntVect::TheDimensionVector(idim));
+        vel[idim].define(ba, dmap[lev], 1, ng);
+        fluxcalc[idim].define(ba, dmap[lev], ncomp, ng-num_grow+1);
+    }
+
+    MultiFab* Sin  = &Sa;
+    MultiFab* Sout = &Sb;
+
+    Long ncells = 0;
+
+    for (int s = 0; s < nblock; ++s)
+    {
+        // the velocity is analytic, so it is evaluated on the grown faces directly
+        const Real t_nph = time + (s+0.5)*dt_lev;
+        DefineGrownVelocity(lev, t_nph, vel, ng-num_grow+2);
+
+        LayoutData<int> props;
+        classify_velocity(vel, props, ng-num_grow+2);
+
+        // region updated in this step
+        const int ng_s = num_grow*(nblock-1-s);
+
+#ifdef _OPENMP
+#pragma omp parallel if (Gpu::notInLaunchRegion()) reduction(+:ncells)
+#endif
+        for (MFIter mfi(*Sin,TilingIfNotGPU()); mfi.isValid(); ++mfi)
+        {
+            const Box& bx = mfi.growntilebox(ng_s);
+
+            Array4<Real> statein  = Sin->array(mfi);
+            Array4<Real> stateout = Sout->array(mfi);
+
+            GpuArray<Array4<Real>, AMREX_SPACEDIM> velarr{ AMREX_D_DECL( vel[0].array(mfi),
+                                                                         vel[1].array(mfi),
+                                                                         vel[2].array(mfi)) };
+
+            GpuArray<Array4<Real>, AMREX_SPACEDIM> flux{ AMREX_D_DECL(fluxcalc[0].array(mfi),
+                                                                      fluxcalc[1].array(mfi),
+                                                                      fluxcalc[2].array(mfi)) };
+
+            compute_flux_tile(bx, statein, velarr, flux, dtdx, props[mfi]);
+
+            // Do a conservative update
+            amrex::ParallelFor(bx,
+            [=] AMREX_GPU_DEVICE (int i, int j, int k)
+            {
+                conservative(i, j, k,
+                             statein, stateout,
+                             AMREX_D_DECL(flux[0], flux[1], flux[2]),
+                             dtdx);
+            });
+
+            ncells += bx.numPts();
+        }
+
+        std::swap(Sin, Sout);
+    }
+
+    MultiFab::Copy(phi_new[lev], *Sin, 0, 0, ncomp, 0);
+
+    const Real comp_time = amrex::second() - strt_time;
+
+    // keep a running estimate of the exchange time and of the cost per cell
+    // updated, used to pick the number of steps per block
+    constexpr Real alpha = 0.5;
+    tb_fill_time = (tb_fill_time < 0.0) ? fill_time : alpha*fill_time + (1.0-alpha)*tb_fill_time;
+    const Real cell_time = comp_time / amrex::max(ncells, Long(1));
+    tb_cell_time = (tb_cell_time < 0.0) ? cell_time : alpha*cell_time + (1.0-alpha)*tb_cell_time;
+
+    advance_time[lev] += fill_time + comp_time;
+    advance_cells[lev] += nblock*CountCells(lev);
+}
+
+// Advance level 0 by nblock time steps of size dt[0] with a single ghost cell exchange
+void
+AmrCoreAdv::timeStepBlocked (Real time, int nblock)
+{
+    const int lev = 0;
+
+    if (Verbose() && !diagnostics) {
+        amrex::Print() << "[Level " << lev << " steps " << istep[lev]+1 << "-" << istep[lev]+nblock << "] ";
+        amrex::Print() << "ADVANCE (blocked) with time = " << t_new[lev]
+                       << " dt = " << dt[lev] << std::endl;
+    }
+
+    t_old[lev] = t_new[lev];
+    t_new[lev] += nblock*dt[lev];
+
+    AdvancePhiBlocked(time, dt[lev], nblock);
+
+    istep[lev] += nblock;
+
+    if (Verbose() && !diagnostics)
+    {
+        amrex::Print() << "[Level " << lev << " step " << istep[lev] << "] ";
+        amrex::Print() << "Advanced " << nblock*CountCells(lev) << " cells" << std::endl;
+    }
+}
+
+// number of level 0 steps to take with a single ghost cell exchange, starting at step
+int
+AmrCoreAdv::BlockedSteps (int step)
+{
+    if (!temporal_blocking || lean || finest_level > 0 || !geom[0].isAllPeriodic()) return 1;
+
+    int kmax = amrex::min(tb_max_nsteps, max_step - step);
+
+    // never step over a regrid, plotfile, checkpoint or slice frame
+    if (max_level > 0 && regrid_int > 0) {
+        if (istep[0] % regrid_int == 0) return 1;
+        kmax = amrex::min(kmax, regrid_int - istep[0] % regrid_int);
+    }
+    if (plot_int > 0) kmax = amrex::min(kmax, plot_int - step % plot_int);
+    if (chk_int  > 0) kmax = amrex::min(kmax, chk_int  - step % chk_int);
+    if (slice_int > 0) kmax = amrex::min(kmax, slice_int - step % slice_int);
+    for (const auto& v : plot_views) {
+        if (v.interval > 0) kmax = amrex::min(kmax, v.interval - step % v.interval);
+    }
+
+    // the whole block uses dt[0]; stop short of stop_time ...
+    const Real eps = 1.e-6*dt[0];
+    while (kmax > 1 && t_new[0] + kmax*dt[0] > stop_time + eps) --kmax;
+
+    if (kmax <= 1) return 1;
+
+    int nblock = kmax;
+
+    if (tb_nsteps > 0)
+    {
+        nblock = amrex::min(tb_nsteps, kmax);
+    }
+    else if (tb_fill_time >= 0.0)
+    {
+        // choose the block length minimizing the modeled cost per step:
+        // one (latency bound) exchange plus the cells updated redundantly
+        constexpr int num_grow = 3;
+        const int myproc = ParallelDescriptor::MyProc();
+
+        Real best_cost = std::numeric_limits<Real>::max();
+        for (int k = 1; k <= kmax; ++k)
+        {
+            Long work = 0;
+            for (int i = 0; i < grids[0].size(); ++i) {
+                if (dmap[0][i] != myproc) continue;
+                for (int s = 0; s < k; ++s) {
+                    work += amrex::grow(grids[0][i], num_grow*(k-1-s)).numPts();
+                }
+            }
+            const Real cost = (tb_fill_time + tb_cell_time*work) / k;
+            if (cost < best_cost) {
+                best_cost = cost;
+                nblock = k;
+            }
+        }
+
+        // every rank must take the same number of steps
+        ParallelDescriptor::ReduceIntMin(nblock);
+    }
+    else
+    {
+        // no measurements yet
+        nblock = 2;
+    }
+
+    // ... and make sure the velocity at the end of the block still satisfies the CFL condition
+    while (nblock > 1 && EstTimeStep(0, t_new[0] + (nblock-1)*dt[0]) < dt[0]) --nblock;
+
+    return nblock;
+}
@@ -0,0 +1,402 @@
+#include <AdvectTile.H>
+#include <Kernels.H>
+
+using namespace amrex;
+
+namespace {
+
+Long variant_cells[static_cast<int>(AdvectVariant::NumVariants)] = {0};
+
+// compute the advective fluxes on the faces of tile bx from the state
+// statein (which needs 3 ghost cells around bx) and the face velocities
+// vel (which need 1 ghost face around bx).
+// On return, flux holds the unscaled fluxes phi*u on the faces of bx.
+template <AdvectVariant V>
+void
+flux_tile (Box const& bx,
+           Array4<Real> const& statein,
+           GpuArray<Array4<Real>, AMREX_SPACEDIM> const& vel,
+           GpuArray<Array4<Real>, AMREX_SPACEDIM> const& flux,
+           GpuArray<Real, AMREX_SPACEDIM> const& dtdx)
+{
+    if (V == AdvectVariant::Frozen)
+    {
+        for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+            Array4<Real> const& f = flux[idim];
+            amrex::ParallelFor(amrex::growHi(bx, idim, 1),
+            [=] AMREX_GPU_DEVICE (int i, int j, int k)
+            {
+                f(i,j,k) = 0.0;
+            });
+        }
+        return;
+    }
+
+    const Box& gbx = amrex::grow(bx, 1);
+
+    AMREX_D_TERM(const Box& dqbxx = amrex::grow(bx, IntVect{AMREX_D_DECL(2, 1, 1)});,
+                 const Box& dqbxy = amrex::grow(bx, IntVect{AMREX_D_DECL(1, 2, 1)});,
+                 const Box& dqbxz = amrex::grow(bx, IntVect{AMREX_D_DECL(1, 1, 2)}););
+
+    FArrayBox slope2fab (amrex::grow(bx, 2), 1);
+    Elixir slope2eli = slope2fab.elixir();
+    Array4<Real> slope2 = slope2fab.array();
+    FArrayBox slope4fab (amrex::grow(bx, 1), 1);
+    Elixir slope4eli = slope4fab.elixir();
+    Array4<Real> slope4 = slope4fab.array();
+
+    // compute longitudinal fluxes
+    // ===========================
+
+    // x -------------------------
+    FArrayBox phixfab (gbx, 1);
+    Elixir phixeli = phixfab.elixir();
+    Array4<Real> phix = phixfab.array();
+
+    amrex::launch(dqbxx,
+    [=] AMREX_GPU_DEVICE (const Box& tbx)
+    {
+        slopex2(tbx, statein, slope2);
+    });
+
+    amrex::launch(gbx,
+    [=] AMREX_GPU_DEVICE (const Box& tbx)
+    {
+        slopex4(tbx, statein, slope2, slope4);
+    });
+
+    amrex::ParallelFor(amrex::growLo(gbx, 0, -1),
+    [=] AMREX_GPU_DEVICE (int i, int j, int k)
+    {
+        flux_x(i, j, k, statein, vel[0], phix, slope4, dtdx); 
+    });
+
+
+    // y -------------------------
+    FArrayBox phiyfab (gbx, 1);
+    Elixir phiyeli = phiyfab.elixir();
+    Array4<Real> phiy = phiyfab.array();
+
+    amrex::launch(dqbxy,
+    [=] AMREX_GPU_DEVICE (const Box& tbx)
+    {
+        slopey2(tbx, statein, slope2);
+    });
+
+    amrex::launch(gbx,
+    [=] AMREX_GPU_DEVICE (const Box& tbx)
+    {
+        slopey4(tbx, statein, slope2, slope4);
+    });
+
+    amrex::ParallelFor(amrex::growLo(gbx, 1, -1),
+    [=] AMREX_GPU_DEVICE (int i, int j, int k)
+    {
+        flux_y(i, j, k, statein, vel[1], phiy, slope4, dtdx); 
+    });
+
+#if (AMREX_SPACEDIM > 2)
+    if (V == AdvectVariant::NoVz)
+    {
+        // the z fluxes vanish and so do all the transverse terms through z faces
+        amrex::ParallelFor(amrex::growHi(bx, 0, 1),
+        [=] AMREX_GPU_DEVICE (int i, int j, int k)
+        {
+            create_flux_x_noz(i, j, k, vel[0], vel[1], phix, phiy, flux[0], dtdx);
+        });
+
+        amrex::ParallelFor(amrex::growHi(bx, 1, 1),
+        [=] AMREX_GPU_DEVICE (int i, int j, int k)
+        {
+            create_flux_y_noz(i, j, k, vel[0], vel[1], phiy, phix, flux[1], dtdx);
+        });
+
+        Array4<Real> const& fz = flux[2];
+        amrex::ParallelFor(amrex::growHi(bx, 2, 1),
+        [=] AMREX_GPU_DEVICE (int i, int j, int k)
+        {
+            fz(i,j,k) = 0.0;
+        });
+        return;
+    }
+
+    // z -------------------------
+    FArrayBox phizfab (gbx, 1);
+    Elixir phizeli = phizfab.elixir();
+    Array4<Real> phiz = phizfab.array();
+
+    amrex::launch(dqbxz,
+    [=] AMREX_GPU_DEVICE (const Box& tbx)
+    {
+        slopez2(tbx, statein, slope2);
+    });
+
+    amrex::launch(gbx,
+    [=] AMREX_GPU_DEVICE (const Box& tbx)
+    {
+        slopez4(tbx, statein, slope2, slope4);
+    });
+
+    amrex::ParallelFor(amrex::growLo(gbx, 2, -1),
+    [=] AMREX_GPU_DEVICE (int i, int j, int k)
+    {
+        flux_z(i, j, k, statein, vel[2], phiz, slope4, dtdx); 
+    });
+
+    // compute transverse fluxes (3D only)
+    // ===================================
+
+    AMREX_D_TERM(const Box& gbxx = amrex::grow(bx, 0, 1);,
+                 const Box& gbxy = amrex::grow(bx, 1, 1);,
+                 const Box& gbxz = amrex::grow(bx, 2, 1););
+
+    // xy --------------------
+    FArrayBox phix_yfab (gbx, 1);
+    Elixir phix_yeli = phix_yfab.elixir();
+    Array4<Real> phix_y = phix_yfab.array();
+
+    amrex::ParallelFor(amrex::growHi(gbxz, 0, 1),
+    [=] AMREX_GPU_DEVICE (int i, int j, int k)
+    {
+        flux_xy(i, j, k, 
+                AMREX_D_DECL(vel[0], vel[1], vel[2]),
+                AMREX_D_DECL(phix, phiy, phiz),
+                phix_y, dtdx);
+    }); 
+
+    // xz --------------------
+    FArrayBox phix_zfab (gbx, 1);
+    Elixir phix_zeli = phix_zfab.elixir();
+    Array4<Real> phix_z = phix_zfab.array();
+
+    amrex::ParallelFor(amrex::growHi(gbxy, 0, 1),
+    [=] AMREX_GPU_DEVICE (int i, int j, int k)
+    {
+        flux_xz(i, j, k,
+                AMREX_D_DECL(vel[0], vel[1], vel[2]),
+                AMREX_D_DECL(phix, phiy, phiz),
+                phix_z, dtdx);
+    }); 
+
+    // yx --------------------
+    FArrayBox phiy_xfab (gbx, 1);
+    FArrayBox phiy_zfab (gbx, 1);
+    Elixir phiy_xeli = phiy_xfab.elixir();
+    Elixir phiy_zeli = phiy_zfab.elixir();
+    Array4<Real> phiy_x = phiy_xfab.array();
+    Array4<Real> phiy_z = phiy_zfab.array();
+
+    amrex::ParallelFor(amrex::growHi(gbxz, 1, 1),
+    [=] AMREX_GPU_DEVICE (int i, int j, int k)
+    {
+        flux_yx(i, j, k,
+                AMREX_D_DECL(vel[0], vel[1], vel[2]),
+                AMREX_D_DECL(phix, phiy, phiz),
+                phiy_x, dtdx);
+    }); 
+
+    // yz --------------------
+    amrex::ParallelFor(amrex::growHi(gbxx, 1, 1),
+    [=] AMREX_GPU_DEVICE (int i, int j, int k)
+    {
+        flux_yz(i, j, k,
+                AMREX_D_DECL(vel[0], vel[1], vel[2]),
+                AMREX_D_DECL(phix, phiy, phiz),
+                phiy_z, dtdx);
+    }); 
+
+    // zx & zy --------------------
+    FArrayBox phiz_xfab (gbx, 1);
+    FArrayBox phiz_yfab (gbx, 1);
+    Elixir phiz_xeli = phiz_xfab.elixir();
+    Elixir phiz_yeli = phiz_yfab.elixir();
+    Array4<Real> phiz_x = phiz_xfab.array();
+    Array4<Real> phiz_y = phiz_yfab.array();
+
+    amrex::ParallelFor(amrex::growHi(gbxy, 2, 1),
+    [=] AMREX_GPU_DEVICE (int i, int j, int k)
+    {
+        flux_zx(i, j, k, 
+                AMREX_D_DECL(vel[0], vel[1], vel[2]),
+                AMREX_D_DECL(phix, phiy, phiz),
+                phiz_x, dtdx);
+    }); 
+
+    amrex::ParallelFor(amrex::growHi(gbxx, 2, 1),
+    [=] AMREX_GPU_DEVICE (int i, int j, int k)
+    {
+        flux_zy(i, j, k,
+                AMREX_D_DECL(vel[0], vel[1], vel[2]),
+                AMREX_D_DECL(phix, phiy, phiz),
+                phiz_y, dtdx);
+    }); 
+#endif
+
+    // final edge states 
+    // ===========================
+    amrex::ParallelFor(amrex::growHi(bx, 0, 1),
+    [=] AMREX_GPU_DEVICE (int i, int j, int k)
+    {
+        create_flux_x(i, j, k,
+                      vel[0], vel[1], 
+#if (AMREX_SPACEDIM > 2)
+                      vel[2],
+                      phix, phiy_z, phiz_y,
+#else
+                      phix, phiy,
+#endif
+                      flux[0], dtdx);
+    });
+
+    amrex::ParallelFor(amrex::growHi(bx, 1, 1),
+    [=] AMREX_GPU_DEVICE (int i, int j, int k)
+    {
+        create_flux_y(i, j, k,
+                      vel[0], vel[1], 
+#if (AMREX_SPACEDIM > 2)
+                      vel[2],
+#endif
+#if (AMREX_SPACEDIM > 2)
+                      phiy, phix_z, phiz_x,
+#else
+                      phiy, phix,
+#endif
+                      flux[1], dtdx);
+    });
+
+#if (AMREX_SPACEDIM > 2)
+    amrex::ParallelFor(amrex::growHi(bx, 2, 1),
+    [=] AMREX_GPU_DEVICE (int i, int j, int k)
+    {
+        create_flux_z(i, j, k,
+                       vel[0], vel[1], vel[2],
+                       phiz, phix_y, phiy_x,
+                       flux[2], dtdx);
+    });
+#endif
+}
+
+}
+
+int
+classify_fab_velocity (Array<FArrayBox const*, AMREX_SPACEDIM> const& vel,
+                       Box const& bx, int ngrow)
+{
+    int p = 0;
+    for (int idim = 0; idim < AMREX_SPACEDIM; ++idim)
+    {
+        const FArrayBox& fab = *vel[idim];
+        const Box& b = amrex::grow(amrex::convert(bx, fab.box().ixType()), ngrow) & fab.box();
+        const Real vmin = fab.min<RunOn::Device>(b, 0);
+        const Real vmax = fab.max<RunOn::Device>(b, 0);
+
+        int pd = 0;
+        if (vmin == 0.0 && vmax == 0.0) pd |= vel_zero;
+        if (vmin == vmax)               pd |= vel_const;
+        if (vmin >= 0.0)                pd |= vel_pos;
+        if (vmax <= 0.0)                pd |= vel_neg;
+
+        p |= pd << (vel_prop_bits*idim);
+    }
+    return p;
+}
+
+void
+classify_velocity (Array<MultiFab, AMREX_SPACEDIM> const& vel,
+                   LayoutData<int>& props, int ngrow)
+{
+    props.define(vel[0].boxArray(), vel[0].DistributionMap());
+
+    for (MFIter mfi(vel[0]); mfi.isValid(); ++mfi)
+    {
+        Array<FArrayBox const*, AMREX_SPACEDIM> fabs{AMREX_D_DECL(&vel[0][mfi], &vel[1][mfi], &vel[2][mfi])};
+        props[mfi] = classify_fab_velocity(fabs, mfi.validbox(), ngrow);
+    }
+}
+
+int
+common_vel_props (LayoutData<int> const& props)
+{
+    int p = vel_prop_all;
+    for (MFIter mfi(props); mfi.isValid(); ++mfi) {
+        p &= props[mfi];
+    }
+
+    // bitwise and over the ranks
+    Vector<int> bits(vel_prop_bits*AMREX_SPACEDIM);
+    for (int i = 0; i < bits.size(); ++i) {
+        bits[i] = (p >> i) & 1;
+    }
+    ParallelDescriptor::ReduceIntMin(bits.data(), bits.size());
+
+    p = 0;
+    for (int i = 0; i < bits.size(); ++i) {
+        p |= bits[i] << i;
+    }
+    return p;
+}
+
+AdvectVariant
+select_variant (int props)
+{
+    bool all_zero = true;
+    for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+        all_zero = all_zero && has_vel_prop(props, idim, vel_zero);
+    }
+    if (all_zero) return AdvectVariant::Frozen;
+
+#if (AMREX_SPACEDIM > 2)
+    if (has_vel_prop(props, 2, vel_zero)) return AdvectVariant::NoVz;
+#endif
+
+    return AdvectVariant::Full;
+}
+
+void
+compute_flux_tile (Box const& bx,
+                   Array4<Real> const& statein,
+                   GpuArray<Array4<Real>, AMREX_SPACEDIM> const& vel,
+                   GpuArray<Array4<Real>, AMREX_SPACEDIM> const& flux,
+                   GpuArray<Real, AMREX_SPACEDIM> const& dtdx,
+                   int props)
+{
+    const AdvectVariant v = select_variant(props);
+
+    switch (v)
+    {
+    case AdvectVariant::Frozen:
+        flux_tile<AdvectVariant::Frozen>(bx, statein, vel, flux, dtdx);
+        break;
+#if (AMREX_SPACEDIM > 2)
+    case AdvectVariant::NoVz:
+        flux_tile<AdvectVariant::NoVz>(bx, statein, vel, flux, dtdx);
+        break;
+#endif
+    default:
+        flux_tile<AdvectVariant::Full>(bx, statein, vel, flux, dtdx);
+        break;
+    }
+
+    const Long npts = bx.numPts();
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+    variant_cells[static_cast<int>(v)] += npts;
+}
+
+Long
+advect_variant_cells (AdvectVariant v)
+{
+    return variant_cells[static_cast<int>(v)];
+}
+
+const char*
+advect_variant_name (AdvectVariant v)
+{
+    switch (v)
+    {
+    case AdvectVariant::Frozen: return "frozen";
+    case AdvectVariant::NoVz:   return "no-vz";
+    default:                    return "full";
+    }
+}
@@ -0,0 +1,108 @@
+#include <AMReX_ParallelDescriptor.H>
+
+#include <AmrCoreAdv.H>
+
+using namespace amrex;
+
+namespace {
+
+// two boxes can be merged if their union is itself a box: they must touch
+// along exactly one direction and have the same extent in all the others
+bool
+can_merge (const Box& a, const Box& b, int max_size)
+{
+    const Box& u = amrex::minBox(a,b);
+    if (u.numPts() != a.numPts() + b.numPts()) return false;
+    for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+        if (u.length(idim) > max_size) return false;
+    }
+    return true;
+}
+
+// ghost cells over valid cells for a BoxArray
+Real
+ghost_ratio (const BoxArray& ba, int ngrow)
+{
+    Long nvalid = 0;
+    Long nghost = 0;
+    for (int i = 0; i < ba.size(); ++i) {
+        nvalid += ba[i].numPts();
+        nghost += amrex::grow(ba[i],ngrow).numPts() - ba[i].numPts();
+    }
+    return (nvalid > 0) ? Real(nghost)/Real(nvalid) : 0.0;
+}
+
+}
+
+// build the aggregated BoxArray and DistributionMapping used to advance level lev
+// on the grids ba, dm (the level's new grids; AMReX sets grids[lev] only after the
+// Make/RemakeLevel callbacks return): boxes that touch and live on the same rank are
+// merged into larger boxes so that the cells on their shared faces no longer need to
+// be filled as ghost cells
+void
+AmrCoreAdv::MakeAggregateGrids (int lev, const BoxArray& ba, const DistributionMapping& dm)
+{
+    // must match the number of ghost cells used to advance phi
+    constexpr int num_grow = 3;
+
+    const int nprocs = ParallelDescriptor::NProcs();
+
+    // every rank knows the whole BoxArray and DistributionMapping,
+    // so every rank builds the same aggregated grids without communication
+    Vector<Vector<Box> > boxes_on_proc(nprocs);
+    for (int i = 0; i < ba.size(); ++i) {
+        boxes_on_proc[dm[i]].push_back(ba[i]);
+    }
+
+    BoxList bl;
+    Vector<int> pmap;
+
+    for (int p = 0; p < nprocs; ++p)
+    {
+        Vector<Box>& bxs = boxes_on_proc[p];
+
+        // greedily merge pairs until no two boxes can be merged
+        bool merged = true;
+        while (merged)
+        {
+            merged = false;
+            for (int i = 0; i < bxs.size() && !merged; ++i) {
+                for (int j = i+1; j < bxs.size() && !merged; ++j) {
+                    if (can_merge(bxs[i], bxs[j], aggregate_max_size)) {
+                        bxs[i] = amrex::minBox(bxs[i], bxs[j]);
+                        bxs.erase(bxs.begin()+j);
+                        merged = true;
+                    }
+                }
+            }
+        }
+
+        for (const Box& b : bxs) {
+            bl.push_back(b);
+            pmap.push_back(p);
+        }
+    }
+
+    agg_grids[lev] = BoxArray(std::move(bl));
+    agg_dmap[lev]  = DistributionMapping(std::move(pmap));
+    agg_src_grids[lev] = ba;
+    agg_src_dmap[lev]  = dm;
+
+    if (Verbose()) {
+        amrex::Print() << "[Level " << lev << "] aggregated " << ba.size() << " boxes into "
+                       << agg_grids[lev].size() << ", ghost/valid cell ratio "
+                       << ghost_ratio(ba, num_grow) << " -> "
+                       << ghost_ratio(agg_grids[lev], num_grow) << std::endl;
+    }
+}
+
+// advance level lev on the aggregated grids: only if they were built for its
+// current grids and merged some boxes
+bool
+AmrCoreAdv::UseAggregateGrids (int lev) const
+{
+    return aggregate_boxes
+        && agg_src_grids[lev] == grids[lev]
+        && agg_src_dmap[lev] == dmap[lev]
+        && agg_grids[lev].size() < grids[lev].size();
+}
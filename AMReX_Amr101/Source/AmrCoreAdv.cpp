@@ -13,6 +13,7 @@
 
 #include <AmrCoreAdv.H>
 #include <Kernels.H>
+#include <AdvectTile.H>
 
 using namespace amrex;
 
@@ -30,6 +31,19 @@ AmrCoreAdv::AmrCoreAdv ()
 
     int nlevs_max = max_level + 1;
 
+    if (do_telemetry) {
+        telemetry.reset(new Telemetry(telemetry_file, nlevs_max, 1));
+    }
+
+    if (diag_int > 0) {
+        diagnostics.reset(new Diagnostics(diag_file, diag_level, diag_int, nlevs_max));
+    }
+
+    // the workload parameters are drawn on the host and copied to the device
+    init_prob_parm(prob_parm, geom[0].ProbLo(), geom[0].ProbHi());
+    d_prob_parm = static_cast<ProbParm*>(The_Arena()->alloc(sizeof(ProbParm)));
+    Gpu::htod_memcpy(d_prob_parm, &prob_parm, sizeof(ProbParm));
+
     istep.resize(nlevs_max, 0);
     nsubsteps.resize(nlevs_max, 1);
     if (do_subcycle) {
@@ -46,6 +60,21 @@ AmrCoreAdv::AmrCoreAdv ()
     phi_old.resize(nlevs_max);
 
     facevel.resize(nlevs_max);
+    psi_cache.resize(nlevs_max);
+    lean_umax.resize(nlevs_max);
+    lean_avg_crse_fine.resize(nlevs_max);
+    lean_avg_time.resize(nlevs_max, 0.0);
+    mem_level_hwm.resize(nlevs_max, 0);
+    vel_props.resize(nlevs_max);
+    vel_level_props.resize(nlevs_max, 0);
+
+    agg_grids.resize(nlevs_max);
+    agg_dmap.resize(nlevs_max);
+    agg_src_grids.resize(nlevs_max);
+    agg_src_dmap.resize(nlevs_max);
+
+    advance_time.resize(nlevs_max, 0.0);
+    advance_cells.resize(nlevs_max, 0);
 
     // periodic boundaries
     int bc_lo[] = {BCType::int_dir, BCType::int_dir, BCType::int_dir};
@@ -91,6 +120,7 @@ AmrCoreAdv::AmrCoreAdv ()
 
 AmrCoreAdv::~AmrCoreAdv ()
 {
+    The_Arena()->free(d_prob_parm);
 }
 
 // advance solution to final time
@@ -100,26 +130,43 @@ AmrCoreAdv::Evolve ()
     Real cur_time = t_new[0];
     int last_plot_file_step = 0;
 
+    // regrids during the run plan the following regrid in the background
+    if (async_regrid && !block_grids) {
+        regrid_plans.resize(max_level);
+    }
+
     for (int step = istep[0]; step < max_step && cur_time < stop_time; ++step)
     {
-        amrex::Print() << "\nCoarse STEP " << step+1 << " starts ..." << std::endl;
+        if (diagnostics) {
+            diagnostics->BeginStep();
+        } else {
+            amrex::Print() << "\nCoarse STEP " << step+1 << " starts ..." << std::endl;
+        }
 
         ComputeDt();
 
         int lev = 0;
         int iteration = 1;
-        if (do_subcycle)
+        const int nblock = BlockedSteps(step);
+        if (nblock > 1)
+            timeStepBlocked(cur_time, nblock);
+        else if (do_subcycle)
             timeStepWithSubcycling(lev, cur_time, iteration);
         else
             timeStepNoSubcycling(cur_time, iteration);
 
-        cur_time += dt[0];
+        cur_time += nblock*dt[0];
+        step += nblock-1;
 
         // sum phi to check conservation
-        Real sum_phi = phi_new[0].sum();
+        if (diagnostics) {
+            diagnostics->EndStep(step+1, cur_time, dt[0], finest_level, phi_new, advance_cells);
+        } else {
+            Real sum_phi = phi_new[0].sum();
 
-        amrex::Print() << "Coarse STEP " << step+1 << " ends." << " TIME = " << cur_time
-                       << " DT = " << dt[0] << " Sum(Phi) = " << sum_phi << std::endl;
+            amrex::Print() << "Coarse STEP " << step+1 << " ends." << " TIME = " << cur_time
+                           << " DT = " << dt[0] << " Sum(Phi) = " << sum_phi << std::endl;
+        }
 
         // sync up time
         for (lev = 0; lev <= finest_level; ++lev) {
@@ -135,6 +182,20 @@ AmrCoreAdv::Evolve ()
             WriteCheckpointFile();
         }
 
+        for (const auto& v : plot_views) {
+            if (v.interval > 0 && (step+1) % v.interval == 0) {
+                WritePlotView(v);
+            }
+        }
+
+        if (slice_int > 0 && (step+1) % slice_int == 0) {
+            WriteSlices();
+        }
+
+        if (telemetry) {
+            telemetry->EndStep(step+1, cur_time, dt[0], finest_level, advance_cells);
+        }
+
 #ifdef AMREX_MEM_PROFILING
         {
             std::ostringstream ss;
@@ -149,6 +210,63 @@ AmrCoreAdv::Evolve ()
     if (plot_int > 0 && istep[0] > last_plot_file_step) {
         WritePlotFile();
     }
+
+    // waits for the plans still being clustered
+    regrid_plans.clear();
+
+    if (telemetry) {
+        telemetry->Finalize();
+    }
+
+    if (diagnostics) {
+        diagnostics->Finalize();
+    }
+
+    if (chk_base_int > 1 && chk_full_bytes > 0) {
+        amrex::Print() << "\nDelta checkpoints: wrote " << chk_bytes << " of " << chk_full_bytes
+                       << " bytes of full checkpoints (" << 100.0*Real(chk_bytes)/Real(chk_full_bytes)
+                       << "%)\n";
+    }
+
+    if (Verbose() || lean) {
+        ReportMemory();
+    }
+
+    ReportReferenceError();
+
+    if (Verbose())
+    {
+        Vector<Real> adv_time(advance_time);
+        ParallelDescriptor::ReduceRealMax(adv_time.data(), adv_time.size());
+
+        amrex::Print() << "\nAdvection rate by level\n";
+        for (int lev = 0; lev <= max_level; ++lev)
+        {
+            if (advance_cells[lev] == 0) continue;
+            amrex::Print() << "  Level " << lev << ": " << advance_cells[lev] << " cells in "
+                           << adv_time[lev] << " s, "
+                           << advance_cells[lev]/adv_time[lev] << " cells/s\n";
+        }
+
+        constexpr int nvariants = static_cast<int>(AdvectVariant::NumVariants);
+        Vector<Long> variant_cells(nvariants);
+        for (int v = 0; v < nvariants; ++v) {
+            variant_cells[v] = advect_variant_cells(static_cast<AdvectVariant>(v));
+        }
+        ParallelDescriptor::ReduceLongSum(variant_cells.data(), nvariants);
+
+        amrex::Print() << "\nCells advanced by kernel variant\n";
+        for (int v = 0; v < nvariants; ++v) {
+            amrex::Print() << "  " << advect_variant_name(static_cast<AdvectVariant>(v))
+                           << ": " << variant_cells[v] << "\n";
+        }
+
+        if (plans_applied + plans_rejected > 0) {
+            amrex::Print() << "\nBackground regrid plans: " << plans_applied << " applied, "
+                           << plans_rejected << " rejected, " << plan_wait_time
+                           << " s waiting for the helper thread\n";
+        }
+    }
 }
 
 // initializes multilevel data
@@ -174,6 +292,8 @@ AmrCoreAdv::InitData ()
     if (plot_int > 0) {
         WritePlotFile();
     }
+
+    PostRegrid();
 }
 
 // Make a new level using provided BoxArray and DistributionMapping and 
@@ -187,21 +307,29 @@ AmrCoreAdv::MakeNewLevelFromCoarse (int lev, Real time, const BoxArray& ba,
     const int nghost = phi_new[lev-1].nGrow();
     
     phi_new[lev].define(ba, dm, ncomp, nghost);
-    phi_old[lev].define(ba, dm, ncomp, nghost);
+    if (!lean) {
+        phi_old[lev].define(ba, dm, ncomp, nghost);
+    }
 
     t_new[lev] = time;
     t_old[lev] = time - 1.e200;
 
     // This clears the old MultiFab and allocates the new one
-    for (int idim = 0; idim < AMREX_SPACEDIM; idim++)
-    {
-	facevel[lev][idim] = MultiFab(amrex::convert(ba,IntVect::TheDimensionVector(idim)), dm, 1, 1);
+    if (!lean) {
+        for (int idim = 0; idim < AMREX_SPACEDIM; idim++)
+        {
+            facevel[lev][idim] = MultiFab(amrex::convert(ba,IntVect::TheDimensionVector(idim)), dm, 1, 1);
+        }
     }
 
-    if (lev > 0 && do_reflux) {
+    if (lev > 0 && do_reflux && !lean) {
 	flux_reg[lev].reset(new FluxRegister(ba, dm, refRatio(lev-1), lev, ncomp));
     }
 
+    if (aggregate_boxes) {
+        MakeAggregateGrids(lev, ba, dm);
+    }
+
     FillCoarsePatch(lev, time, phi_new[lev], 0, ncomp);
 }
 
@@ -216,7 +344,10 @@ AmrCoreAdv::RemakeLevel (int lev, Real time, const BoxArray& ba,
     const int nghost = phi_new[lev].nGrow();
 
     MultiFab new_state(ba, dm, ncomp, nghost);
-    MultiFab old_state(ba, dm, ncomp, nghost);
+    MultiFab old_state;
+    if (!lean) {
+        old_state.define(ba, dm, ncomp, nghost);
+    }
 
     FillPatch(lev, time, new_state, 0, ncomp);
 
@@ -227,14 +358,20 @@ AmrCoreAdv::RemakeLevel (int lev, Real time, const BoxArray& ba,
     t_old[lev] = time - 1.e200;
 
     // This clears the old MultiFab and allocates the new one
-    for (int idim = 0; idim < AMREX_SPACEDIM; idim++)
-    {
-	facevel[lev][idim] = MultiFab(amrex::convert(ba,IntVect::TheDimensionVector(idim)), dm, 1, 1);
+    if (!lean) {
+        for (int idim = 0; idim < AMREX_SPACEDIM; idim++)
+        {
+            facevel[lev][idim] = MultiFab(amrex::convert(ba,IntVect::TheDimensionVector(idim)), dm, 1, 1);
+        }
     }
 
-    if (lev > 0 && do_reflux) {
+    if (lev > 0 && do_reflux && !lean) {
 	flux_reg[lev].reset(new FluxRegister(ba, dm, refRatio(lev-1), lev, ncomp));
     }    
+
+    if (aggregate_boxes) {
+        MakeAggregateGrids(lev, ba, dm);
+    }
 }
 
 // Delete level data
@@ -244,7 +381,13 @@ AmrCoreAdv::ClearLevel (int lev)
 {
     phi_new[lev].clear();
     phi_old[lev].clear();
+    psi_cache[lev].clear();
+    lean_avg_crse_fine[lev] = BoxArray();
     flux_reg[lev].reset(nullptr);
+    agg_grids[lev] = BoxArray();
+    agg_dmap[lev] = DistributionMapping();
+    agg_src_grids[lev] = BoxArray();
+    agg_src_dmap[lev] = DistributionMapping();
 }
 
 // Make a new level from scratch using provided BoxArray and DistributionMapping.
@@ -257,21 +400,29 @@ void AmrCoreAdv::MakeNewLevelFromScratch (int lev, Real time, const BoxArray& ba
     const int nghost = 0;
 
     phi_new[lev].define(ba, dm, ncomp, nghost);
-    phi_old[lev].define(ba, dm, ncomp, nghost);
+    if (!lean) {
+        phi_old[lev].define(ba, dm, ncomp, nghost);
+    }
 
     t_new[lev] = time;
     t_old[lev] = time - 1.e200;
 
     // This clears the old MultiFab and allocates the new one
-    for (int idim = 0; idim < AMREX_SPACEDIM; idim++)
-    {
-	facevel[lev][idim] = MultiFab(amrex::convert(ba,IntVect::TheDimensionVector(idim)), dm, 1, 1);
+    if (!lean) {
+        for (int idim = 0; idim < AMREX_SPACEDIM; idim++)
+        {
+            facevel[lev][idim] = MultiFab(amrex::convert(ba,IntVect::TheDimensionVector(idim)), dm, 1, 1);
+        }
     }
 
-    if (lev > 0 && do_reflux) {
+    if (lev > 0 && do_reflux && !lean) {
 	flux_reg[lev].reset(new FluxRegister(ba, dm, refRatio(lev-1), lev, ncomp));
     }
 
+    if (aggregate_boxes) {
+        MakeAggregateGrids(lev, ba, dm);
+    }
+
     Real cur_time = t_new[lev];
     MultiFab& state = phi_new[lev];
 
@@ -281,11 +432,23 @@ void AmrCoreAdv::MakeNewLevelFromScratch (int lev, Real time, const BoxArray& ba
         GeometryData geomData = geom[lev].data();
         const Box& box = mfi.validbox();
 
-        amrex::launch(box,
-        [=] AMREX_GPU_DEVICE (Box const& tbx)
+        if (prob_parm.workload == Workload::Blob)
+        {
+            amrex::launch(box,
+            [=] AMREX_GPU_DEVICE (Box const& tbx)
+            {
+                initdata(tbx, fab, geomData);
+            });
+        }
+        else
         {
-            initdata(tbx, fab, geomData);
-        });
+            const ProbParm* pp = d_prob_parm;
+            amrex::ParallelFor(box,
+            [=] AMREX_GPU_DEVICE (int i, int j, int k) noexcept
+            {
+                initdata_workload(i, j, k, fab, geomData, pp);
+            });
+        }
     }
 }
 
@@ -294,31 +457,82 @@ void AmrCoreAdv::MakeNewLevelFromScratch (int lev, Real time, const BoxArray& ba
 void
 AmrCoreAdv::ErrorEst (int lev, TagBoxArray& tags, Real time, int ngrow)
 {
+    TelemetryTimer tt(telemetry.get(), TelemetryPhase::ErrorEst, lev);
+
     static bool first = true;
     static Vector<Real> phierr;
+    static Vector<Real> graderr;
+    static Vector<Real> lohnererr;
+    static Vector<Real> velerr;
 
     // only do this during the first call to ErrorEst
     if (first)
     {
 	first = false;
-        // read in an array of "phierr", which is the tagging threshold
-        // in this example, we tag values of "phi" which are greater than phierr
-        // for that particular level
-        // in subroutine state_error, you could use more elaborate tagging, such
-        // as more advanced logical expressions, or gradients, etc.
+        // read in the per-level thresholds of the tagging criteria:
+        // phierr    - tag where phi is greater than phierr
+        // graderr   - tag where the undivided gradient of phi is greater than graderr
+        // lohnererr - tag where the Loehner second derivative indicator is greater than lohnererr
+        // velerr    - tag where phi changes by more than velerr in a time step
+        // all criteria are evaluated in a single pass in tag_error
 	ParmParse pp("adv");
 	int n = pp.countval("phierr");
 	if (n > 0) {
 	    pp.getarr("phierr", phierr, 0, n);
 	}
+	n = pp.countval("graderr");
+	if (n > 0) {
+	    pp.getarr("graderr", graderr, 0, n);
+	}
+	n = pp.countval("lohnererr");
+	if (n > 0) {
+	    pp.getarr("lohnererr", lohnererr, 0, n);
+	}
+	n = pp.countval("velerr");
+	if (n > 0) {
+	    pp.getarr("velerr", velerr, 0, n);
+	}
     }
 
-    if (lev >= phierr.size()) return;
+    TagCriteria crit;
+
+    // with adv.refine_fraction, the threshold is set so that the requested
+    // fraction of the domain is refined to level lev+1
+    if (lev < refine_fraction.size()) {
+        crit.phierr = RefineThreshold(refine_fraction[lev]);
+    } else if (lev < phierr.size()) {
+        crit.phierr = phierr[lev];
+    }
+    if (lev < graderr.size())   crit.graderr   = graderr[lev];
+    if (lev < lohnererr.size()) crit.lohnererr = lohnererr[lev];
+    if (lev < velerr.size())    crit.velerr    = velerr[lev];
+
+    if (crit.phierr < 0.0 && !crit.needs_ghost()) return;
 
 //    const int clearval = TagBox::CLEAR;
     const int   tagval = TagBox::SET;
 
-    const MultiFab& state = phi_new[lev];
+    // the derivative criteria need one ghost cell
+    MultiFab Sborder;
+    if (crit.needs_ghost()) {
+        Sborder.define(grids[lev], dmap[lev], phi_new[lev].nComp(), 1);
+        FillPatch(lev, time, Sborder, 0, Sborder.nComp());
+    }
+    const MultiFab& state = crit.needs_ghost() ? Sborder : phi_new[lev];
+
+    // the velocity criterion needs the face velocity and a time step
+    GpuArray<Real, AMREX_SPACEDIM> dtdx;
+    if (crit.velerr >= 0.0) {
+        const Real dt_tag = (dt[lev] < 1.e99) ? dt[lev] : EstTimeStep(lev, time);
+        DefineVelocityAtLevel(lev, time);
+        for (int d = 0; d < AMREX_SPACEDIM; ++d) {
+            dtdx[d] = dt_tag / geom[lev].CellSize(d);
+        }
+    }
+
+    // count which criterion tagged each cell
+    Gpu::DeviceVector<int> dcount(num_tag_reasons, 0);
+    int* count = dcount.data();
 
 #ifdef _OPENMP
 #pragma omp parallel if(Gpu::notInLaunchRegion())
@@ -328,17 +542,80 @@ AmrCoreAdv::ErrorEst (int lev, TagBoxArray& tags, Real time, int ngrow)
 	for (MFIter mfi(state,TilingIfNotGPU()); mfi.isValid(); ++mfi)
 	{
 	    const Box& bx  = mfi.tilebox();
-            const auto statefab = state.array(mfi);
+            const auto statefab = state.const_array(mfi);
             const auto tagfab  = tags.array(mfi);
-            Real phierror = phierr[lev];
+
+            // the face velocity is only read by the velocity criterion
+            GpuArray<Array4<Real const>, AMREX_SPACEDIM> vel;
+            Array<FArrayBox, AMREX_SPACEDIM> velfab;
+            Array<Elixir, AMREX_SPACEDIM> veleli;
+            if (crit.velerr >= 0.0) {
+                if (lean) {
+                    LeanFaceVelocity(lev, bx, mfi.validbox(), psi_cache[lev][mfi], velfab);
+                }
+                for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+                    if (lean) {
+                        veleli[idim] = velfab[idim].elixir();
+                        vel[idim] = velfab[idim].const_array();
+                    } else {
+                        vel[idim] = facevel[lev][idim].const_array(mfi);
+                    }
+                }
+            }
+            AMREX_D_TERM(const auto vx = vel[0];,
+                         const auto vy = vel[1];,
+                         const auto vz = vel[2];);
 	    
             amrex::ParallelFor(bx,
             [=] AMREX_GPU_DEVICE (int i, int j, int k) noexcept
             {
-                state_error(i, j, k, tagfab, statefab, phierror, tagval);
+                const int reason = tag_error(i, j, k, tagfab, statefab,
+                                             AMREX_D_DECL(vx, vy, vz),
+                                             crit, dtdx, tagval);
+                if (reason >= 0) {
+                    HostDevice::Atomic::Add(count+reason, 1);
+                }
             });
 	}
     }
+
+    if (Verbose())
+    {
+        Vector<int> icount(num_tag_reasons);
+        Gpu::copy(Gpu::deviceToHost, dcount.begin(), dcount.end(), icount.begin());
+        Vector<Long> ntags(icount.begin(), icount.end());
+        ParallelDescriptor::ReduceLongSum(ntags.data(), ntags.size());
+
+        amrex::Print() << "[Level " << lev << "] tagged cells: value " << ntags[tag_by_value]
+                       << ", gradient " << ntags[tag_by_gradient]
+                       << ", lohner " << ntags[tag_by_lohner]
+                       << ", velocity " << ntags[tag_by_velocity]
+                       << " of " << CountCells(lev) << std::endl;
+    }
+}
+
+// Make a DistributionMapping for a new or regridded level.
+// Levels up to coarse_max_level can be restricted to a subset of the ranks.
+// overrides the virtual function in AmrMesh
+DistributionMapping
+AmrCoreAdv::MakeDistributionMap (int lev, const BoxArray& ba)
+{
+    const int nprocs = ParallelDescriptor::NProcs();
+
+    if (coarse_nprocs <= 0 || coarse_nprocs >= nprocs || lev > coarse_max_level) {
+        return AmrCore::MakeDistributionMap(lev, ba);
+    }
+
+    // balance the boxes over coarse_nprocs ranks, then spread those
+    // ranks out so that each one lands on a different node (or socket)
+    DistributionMapping sub_dm(ba, coarse_nprocs);
+
+    Vector<int> pmap = sub_dm.ProcessorMap();
+    for (auto& p : pmap) {
+        p *= coarse_proc_stride;
+    }
+
+    return DistributionMapping(std::move(pmap));
 }
 
 // read in some parameters from inputs file
@@ -359,7 +636,52 @@ AmrCoreAdv::ReadParameters ()
 	pp.query("plot_int", plot_int);
 	pp.query("chk_file", chk_file);
 	pp.query("chk_int", chk_int);
+	pp.query("chk_base_int", chk_base_int);
+        pp.query("slice_file", slice_file);
+        pp.query("slice_int", slice_int);
+        pp.queryarr("slice_dir", slice_dir);
+        pp.queryarr("slice_pos", slice_pos);
+        pp.queryarr("slice_npix", slice_npix);
+        pp.queryarr("slice_range", slice_range);
         pp.query("restart",restart_chkfile);
+
+        pp.query("coarse_nprocs", coarse_nprocs);
+        pp.query("coarse_max_level", coarse_max_level);
+        pp.query("coarse_proc_stride", coarse_proc_stride);
+        pp.query("comm_report", comm_report);
+        pp.query("telemetry", do_telemetry);
+        pp.query("telemetry_file", telemetry_file);
+        pp.query("diag_int", diag_int);
+        pp.query("diag_level", diag_level);
+        pp.query("diag_file", diag_file);
+        pp.query("block_grids", block_grids);
+        pp.query("block_size", block_size);
+        pp.query("async_regrid", async_regrid);
+
+        if (diag_level < 0 || diag_level > 3) {
+            amrex::Abort("amr.diag_level must be between 0 and 3");
+        }
+        if (coarse_proc_stride < 1) {
+            amrex::Abort("amr.coarse_proc_stride must be >= 1");
+        }
+
+        ReadPlotViews();
+
+        if (slice_dir.empty()) {
+            slice_dir.push_back(2);
+        }
+        for (int d : slice_dir) {
+            if (d < 0 || d > 2) {
+                amrex::Abort("amr.slice_dir must be 0, 1 or 2");
+            }
+        }
+        if (slice_npix.size() != 2 || slice_npix[0] < 1 || slice_npix[1] < 1) {
+            amrex::Abort("amr.slice_npix needs two positive values");
+        }
+        if (coarse_nprocs > 0 &&
+            (coarse_nprocs-1)*coarse_proc_stride >= ParallelDescriptor::NProcs()) {
+            amrex::Abort("amr.coarse_nprocs * amr.coarse_proc_stride exceeds the number of ranks");
+        }
     }
 
     {
@@ -368,6 +690,25 @@ AmrCoreAdv::ReadParameters ()
 	pp.query("cfl", cfl);
         pp.query("do_reflux", do_reflux);
         pp.query("do_subcycle", do_subcycle);
+        pp.query("aggregate_boxes", aggregate_boxes);
+        pp.query("aggregate_max_size", aggregate_max_size);
+        pp.query("temporal_blocking", temporal_blocking);
+        pp.query("tb_nsteps", tb_nsteps);
+        pp.query("tb_max_nsteps", tb_max_nsteps);
+        pp.query("lean", lean);
+
+        int n = pp.countval("refine_fraction");
+        if (n > 0) {
+            pp.getarr("refine_fraction", refine_fraction, 0, n);
+        }
+        pp.query("tag_reference", tag_reference);
+
+        if (tb_max_nsteps < 1) {
+            amrex::Abort("adv.tb_max_nsteps must be >= 1");
+        }
+        if (lean && (do_subcycle || aggregate_boxes)) {
+            amrex::Abort("adv.lean requires adv.do_subcycle = 0 and adv.aggregate_boxes = 0");
+        }
     }
 }
 
@@ -377,6 +718,9 @@ AmrCoreAdv::AverageDown ()
 {
     for (int lev = finest_level-1; lev >= 0; --lev)
     {
+        TelemetryTimer tt(telemetry.get(), TelemetryPhase::AverageDown, lev+1);
+        if (telemetry) telemetry->AddAverageDown(lev+1);
+
 	amrex::average_down(phi_new[lev+1], phi_new[lev],
                             geom[lev+1], geom[lev],
                             0, phi_new[lev].nComp(), refRatio(lev));
@@ -387,6 +731,9 @@ AmrCoreAdv::AverageDown ()
 void
 AmrCoreAdv::AverageDownTo (int crse_lev)
 {
+    TelemetryTimer tt(telemetry.get(), TelemetryPhase::AverageDown, crse_lev+1);
+    if (telemetry) telemetry->AddAverageDown(crse_lev+1);
+
     amrex::average_down(phi_new[crse_lev+1], phi_new[crse_lev],
                         geom[crse_lev+1], geom[crse_lev],
                         0, phi_new[crse_lev].nComp(), refRatio(crse_lev));
@@ -397,6 +744,9 @@ AmrCoreAdv::AverageDownTo (int crse_lev)
 void
 AmrCoreAdv::FillPatch (int lev, Real time, MultiFab& mf, int icomp, int ncomp)
 {
+    TelemetryTimer tt(telemetry.get(), TelemetryPhase::FillPatch, lev);
+    if (telemetry) telemetry->AddFillPatch(lev);
+
     if (lev == 0)
     {
 	Vector<MultiFab*> smf;
@@ -506,11 +856,13 @@ AmrCoreAdv::GetData (int lev, Real time, Vector<MultiFab*>& data, Vector<Real>&
     }
     else if (time > t_old[lev] - teps && time < t_old[lev] + teps)
     {
+        AMREX_ALWAYS_ASSERT_WITH_MESSAGE(!lean, "adv.lean keeps no phi_old");
 	data.push_back(&phi_old[lev]);
 	datatime.push_back(t_old[lev]);
     }
     else
     {
+        AMREX_ALWAYS_ASSERT_WITH_MESSAGE(!lean, "adv.lean keeps no phi_old");
 	data.push_back(&phi_old[lev]);
 	data.push_back(&phi_new[lev]);
 	datatime.push_back(t_old[lev]);
@@ -541,7 +893,12 @@ AmrCoreAdv::timeStepWithSubcycling (int lev, Real time, int iteration)
                 // regrid could add newly refine levels (if finest_level < max_level)
                 // so we save the previous finest level index
                 int old_finest = finest_level; 
-                regrid(lev, time);
+                {
+                    TelemetryTimer tt(telemetry.get(), TelemetryPhase::Regrid);
+                    regrid(lev, time);
+                }
+
+                PostRegrid();
 
                 // mark that we have regridded this level already
                 for (int k = lev; k <= finest_level; ++k) {
@@ -556,7 +913,7 @@ AmrCoreAdv::timeStepWithSubcycling (int lev, Real time, int iteration)
         }
     }
 
-    if (Verbose()) {
+    if (Verbose() && !diagnostics) {
         amrex::Print() << "[Level " << lev << " step " << istep[lev]+1 << "] ";
         amrex::Print() << "ADVANCE with time = " << t_new[lev] 
                        << " dt = " << dt[lev] << std::endl;
@@ -574,7 +931,7 @@ AmrCoreAdv::timeStepWithSubcycling (int lev, Real time, int iteration)
 
     ++istep[lev];
 
-    if (Verbose())
+    if (Verbose() && !diagnostics)
     {
         amrex::Print() << "[Level " << lev << " step " << istep[lev] << "] ";
         amrex::Print() << "Advanced " << CountCells(lev) << " cells" << std::endl;
@@ -591,6 +948,7 @@ AmrCoreAdv::timeStepWithSubcycling (int lev, Real time, int iteration)
         if (do_reflux)
         {
             // update lev based on coarse-fine flux mismatch
+            TelemetryTimer tt(telemetry.get(), TelemetryPhase::Reflux, lev);
             flux_reg[lev+1]->Reflux(phi_new[lev], 1.0, 0, 0, phi_new[lev].nComp(), geom[lev]);
         }
 
@@ -610,11 +968,16 @@ AmrCoreAdv::timeStepNoSubcycling (Real time, int iteration)
             // Regrid could add newly refine levels (if finest_level < max_level)
             // so we save the previous finest level index
             int old_finest = finest_level; 
-            regrid(0, time);
+            {
+                TelemetryTimer tt(telemetry.get(), TelemetryPhase::Regrid);
+                regrid(0, time);
+            }
+
+            PostRegrid();
         }
     }
 
-    if (Verbose()) {
+    if (Verbose() && !diagnostics) {
         for (int lev = 0; lev <= finest_level; lev++)
         {
            amrex::Print() << "[Level " << lev << " step " << istep[lev]+1 << "] ";
@@ -632,7 +995,7 @@ AmrCoreAdv::timeStepNoSubcycling (Real time, int iteration)
     for (int lev = 0; lev <= finest_level; lev++)
         ++istep[lev];
 
-    if (Verbose())
+    if (Verbose() && !diagnostics)
     {
         for (int lev = 0; lev <= finest_level; lev++)
         {
@@ -647,6 +1010,8 @@ AmrCoreAdv::timeStepNoSubcycling (Real time, int iteration)
 void
 AmrCoreAdv::ComputeDt ()
 {
+    TelemetryTimer tt(telemetry.get(), TelemetryPhase::ComputeDt);
+
     Vector<Real> dt_tmp(finest_level+1);
 
     for (int lev = 0; lev <= finest_level; ++lev)
@@ -702,7 +1067,10 @@ AmrCoreAdv::EstTimeStep (int lev, Real time, bool local)
 
     for (int idim = 0; idim < AMREX_SPACEDIM; ++idim)
     {
-        Real est = facevel[lev][idim].norm0(0,0,local);
+        // a component that is zero everywhere puts no limit on dt
+        if (has_vel_prop(vel_level_props[lev], idim, vel_zero)) continue;
+
+        Real est = MaxFaceVelocity(lev, idim, local);
         // amrex::Print() << "Max vel in " << coord_dir[idim] << "-direction is " << est << std::endl;
         dt_est = amrex::min(dt_est, dx[idim]/est);
     }
@@ -745,6 +1113,8 @@ AmrCoreAdv::PlotFileVarNames () const
 void
 AmrCoreAdv::WritePlotFile () const
 {
+    TelemetryTimer tt(telemetry.get(), TelemetryPhase::IO);
+
     const std::string& plotfilename = PlotFileName(istep[0]);
     const auto& mf = PlotFileMF();
     const auto& varnames = PlotFileVarNames();
@@ -756,8 +1126,9 @@ AmrCoreAdv::WritePlotFile () const
 }
 
 void
-AmrCoreAdv::WriteCheckpointFile () const
+AmrCoreAdv::WriteCheckpointFile ()
 {
+    TelemetryTimer tt(telemetry.get(), TelemetryPhase::IO);
 
     // chk00010            write a checkpoint file with this root directory
     // chk00010/Header     this contains information you need to save (e.g., finest_level, t_new, etc.) and also
@@ -769,7 +1140,16 @@ AmrCoreAdv::WriteCheckpointFile () const
     // checkpoint file name, e.g., chk00010
     const std::string& checkpointname = amrex::Concatenate(chk_file,istep[0]);
 
-    amrex::Print() << "Writing checkpoint " << checkpointname << "\n";
+    // with chk_base_int > 1 only every chk_base_int-th checkpoint is full,
+    // the others hold the difference to the previous one
+    const bool delta = chk_base_int > 1 && chk_count % chk_base_int != 0 && !chk_last.empty();
+    ++chk_count;
+
+    if (delta) {
+        amrex::Print() << "Writing checkpoint " << checkpointname << " (delta of " << chk_last_name << ")\n";
+    } else {
+        amrex::Print() << "Writing checkpoint " << checkpointname << "\n";
+    }
 
     const int nlevels = finest_level+1;
 
@@ -829,11 +1209,44 @@ AmrCoreAdv::WriteCheckpointFile () const
    }
 
    // write the MultiFab data to, e.g., chk00010/Level_0/
+   Long bytes = 0;
+   Long full_bytes = 0;
+   Vector<int> level_full(nlevels, 1);
    for (int lev = 0; lev <= finest_level; ++lev) {
-       VisMF::Write(phi_new[lev],
-                    amrex::MultiFabFileFullPrefix(lev, checkpointname, "Level_", "phi"));
+       const Long lev_bytes = grids[lev].numPts()*phi_new[lev].nComp()*sizeof(Real);
+       full_bytes += lev_bytes;
+       if (delta && CanWriteDelta(lev)) {
+           level_full[lev] = 0;
+           bytes += WriteLevelDelta(lev, checkpointname);
+       } else {
+           bytes += lev_bytes;
+           VisMF::Write(phi_new[lev],
+                        amrex::MultiFabFileFullPrefix(lev, checkpointname, "Level_", "phi"));
+       }
    }
 
+   if (delta && ParallelDescriptor::IOProcessor()) {
+       std::string DeltaFileName(checkpointname + "/Delta");
+       std::ofstream DeltaFile(DeltaFileName.c_str(), std::ofstream::out | std::ofstream::trunc);
+       if( ! DeltaFile.good()) {
+           amrex::FileOpenFailed(DeltaFileName);
+       }
+       // the parent sits in the same directory, so only its name is stored
+       DeltaFile << chk_last_name.substr(chk_last_name.find_last_of('/') + 1) << "\n";
+       for (int lev = 0; lev <= finest_level; ++lev) {
+           DeltaFile << level_full[lev] << " ";
+       }
+       DeltaFile << "\n";
+   }
+
+   if (chk_base_int > 1) {
+       SaveCheckpointState(checkpointname);
+
+       chk_bytes += bytes;
+       chk_full_bytes += full_bytes;
+       amrex::Print() << "  wrote " << bytes << " bytes, "
+                      << Real(bytes)/Real(full_bytes) << " of a full checkpoint\n";
+   }
 }
 
 
@@ -900,7 +1313,7 @@ AmrCoreAdv::ReadCheckpointFile ()
         GotoNextLine(is);
 
         // create a distribution mapping
-        DistributionMapping dm { ba, ParallelDescriptor::NProcs() };
+        DistributionMapping dm = MakeDistributionMap(lev, ba);
 
         // set BoxArray grids and DistributionMapping dmap in AMReX_AmrMesh.H class
         SetBoxArray(lev, ba);
@@ -909,24 +1322,48 @@ AmrCoreAdv::ReadCheckpointFile ()
         // build MultiFab and FluxRegister data
         int ncomp = 1;
         int nghost = 0;
-        phi_old[lev].define(grids[lev], dmap[lev], ncomp, nghost);
+        if (!lean) {
+            phi_old[lev].define(grids[lev], dmap[lev], ncomp, nghost);
+        }
         phi_new[lev].define(grids[lev], dmap[lev], ncomp, nghost);
 
-        if (lev > 0 && do_reflux) {
+        if (lev > 0 && do_reflux && !lean) {
             flux_reg[lev].reset(new FluxRegister(grids[lev], dmap[lev], refRatio(lev-1), lev, ncomp));
         }
 
         // build face velocity MultiFabs
-        for (int idim = 0; idim < AMREX_SPACEDIM; idim++)
-        {
-	    facevel[lev][idim] = MultiFab(amrex::convert(ba,IntVect::TheDimensionVector(idim)), dm, 1, 1);
+        if (!lean) {
+            for (int idim = 0; idim < AMREX_SPACEDIM; idim++)
+            {
+                facevel[lev][idim] = MultiFab(amrex::convert(ba,IntVect::TheDimensionVector(idim)), dm, 1, 1);
+            }
+        }
+
+        if (aggregate_boxes) {
+            MakeAggregateGrids(lev, ba, dm);
         }
     }
 
-    // read in the MultiFab data
+    // read in the MultiFab data, replaying the deltas of a delta checkpoint
+    // on top of the last checkpoint that holds each level in full
+    Vector<std::string> chain;
+    Vector<Vector<int> > level_full;
+    ReadCheckpointChain(chain, level_full);
+
     for (int lev = 0; lev <= finest_level; ++lev) {
+        int base = chain.size()-1;
+        while (base > 0 && !(lev < level_full[base].size() && level_full[base][lev])) {
+            --base;
+        }
         VisMF::Read(phi_new[lev],
-                    amrex::MultiFabFileFullPrefix(lev, restart_chkfile, "Level_", "phi"));
+                    amrex::MultiFabFileFullPrefix(lev, chain[base], "Level_", "phi"));
+        for (int k = base+1; k < chain.size(); ++k) {
+            ReadLevelDelta(lev, chain[k]);
+        }
+    }
+
+    if (chain.size() > 1) {
+        amrex::Print() << "  replayed " << chain.size()-1 << " delta checkpoint(s) on top of " << chain[0] << "\n";
     }
 
 }
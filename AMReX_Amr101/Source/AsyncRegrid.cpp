@@ -0,0 +1,187 @@
+#include <algorithm>
+
+#include <AMReX_Cluster.H>
+#include <AMReX_Loop.H>
+#include <AMReX_ParallelDescriptor.H>
+#include <AMReX_TagBox.H>
+
+#include <AmrCoreAdv.H>
+
+using namespace amrex;
+
+// Regrid with the clustering done off the critical path.
+//
+// The tags are still collected at every regrid (ErrorEst and the collate are
+// collective), but the grids applied are the ones clustered from the tags of
+// the previous regrid of the same base level, on a helper thread while the
+// steps in between advanced. The lagged plan is only used if it still covers
+// all current tags and nests in the current grids of the base level;
+// otherwise the current tags are clustered right away, as AmrCore would.
+// The distribution maps are made by AmrCore::regrid on the main thread.
+void
+AmrCoreAdv::MakeNewGridsAsync (int lbase, Real time, int& new_finest, Vector<BoxArray>& new_grids)
+{
+    BL_PROFILE("AmrCoreAdv::MakeNewGridsAsync()");
+
+    RegridPlan fresh;
+    CollectTags(lbase, time, fresh);
+
+    bool use_plan = false;
+    RegridPlan plan;
+
+    auto& pending = regrid_plans[lbase];
+    if (pending.valid())
+    {
+        const Real strt_time = amrex::second();
+        plan = pending.get();
+        plan_wait_time += amrex::second() - strt_time;
+
+        use_plan = plan.max_crse == fresh.max_crse
+            && plan.base_grids == fresh.base_grids
+            && PlanCovers(plan, fresh);
+        ParallelDescriptor::ReduceBoolAnd(use_plan);
+
+        if (use_plan) {
+            ++plans_applied;
+        } else {
+            ++plans_rejected;
+        }
+    }
+
+    if (!use_plan) {
+        plan = fresh;
+        ClusterTags(plan);
+    }
+
+    if (Verbose()) {
+        amrex::Print() << "Regrid from level " << lbase << ": "
+                       << (use_plan ? "applied background plan" : "clustered synchronously")
+                       << std::endl;
+    }
+
+    new_finest = plan.new_finest;
+    new_grids.resize(std::max(new_grids.size(), plan.new_grids.size()));
+    for (int lev = lbase+1; lev <= new_finest; ++lev) {
+        new_grids[lev] = plan.new_grids[lev];
+    }
+
+    // plan the next regrid of this base level from the current tags.
+    // TinyProfiler and the other profilers keep global region stacks, so
+    // with profiling on the clustering is deferred to the main thread.
+#ifdef BL_PROFILING
+    const auto policy = std::launch::deferred;
+#else
+    const auto policy = std::launch::async;
+#endif
+    pending = std::async(policy, [this, p = std::move(fresh)] () mutable
+    {
+        ClusterTags(p);
+        return p;
+    });
+}
+
+// tag, buffer and coarsen levels lbase and up as in AmrMesh::MakeNewGrids,
+// so that every rank holds all tags in units of the blocking factor
+void
+AmrCoreAdv::CollectTags (int lbase, Real time, RegridPlan& plan)
+{
+    plan.lbase = lbase;
+    plan.max_crse = std::min(finest_level, max_level-1);
+    plan.base_grids = grids[lbase];
+
+    NestingRegions(lbase, plan.max_crse, plan.bf_lev, plan.p_n);
+
+    plan.tags.resize(plan.max_crse+1);
+    for (int lev = lbase; lev <= plan.max_crse; ++lev)
+    {
+        TagBoxArray tags(grids[lev], dmap[lev], n_error_buf[lev]);
+        ErrorEst(lev, tags, time, 0);
+
+        tags.buffer(n_error_buf[lev]);
+        tags.mapPeriodicRemoveDuplicates(geom[lev]);
+        tags.coarsen(plan.bf_lev[lev]);
+        tags.collate(plan.tags[lev]);
+    }
+}
+
+// cluster from the finest level down, adding the cells needed to properly
+// nest the level above, as AmrMesh does
+void
+AmrCoreAdv::ClusterTags (RegridPlan& plan) const
+{
+    plan.new_finest = plan.lbase;
+    plan.new_grids.clear();
+    plan.new_grids.resize(plan.max_crse+2);
+
+    for (int lev = plan.max_crse; lev >= plan.lbase; --lev)
+    {
+        const IntVect& bf = plan.bf_lev[lev];
+
+        std::vector<IntVect> pts(plan.tags[lev].begin(), plan.tags[lev].end());
+
+        if (lev+2 <= plan.new_finest)
+        {
+            BoxArray ba_f = plan.new_grids[lev+2];
+            ba_f.coarsen(ref_ratio[lev+1]);
+            ba_f.grow(n_proper);
+            ba_f.coarsen(ref_ratio[lev]);
+            ba_f.grow(n_error_buf[lev]);
+            ba_f.coarsen(bf);
+
+            const Box& pc_domain = amrex::coarsen(geom[lev].Domain(), bf);
+            for (int i = 0; i < ba_f.size(); ++i)
+            {
+                const Box& b = ba_f[i] & pc_domain;
+                if (!b.ok()) continue;
+                amrex::LoopOnCpu(b, [&] (int ii, int jj, int kk)
+                {
+                    amrex::ignore_unused(ii,jj,kk);
+                    pts.push_back(IntVect(AMREX_D_DECL(ii,jj,kk)));
+                });
+            }
+
+            std::sort(pts.begin(), pts.end());
+            pts.erase(std::unique(pts.begin(), pts.end()), pts.end());
+        }
+
+        if (pts.empty()) continue;
+
+        ClusterList clist(pts.data(), pts.size());
+        clist.chop(grid_eff);
+
+        BoxArray pn_ba(plan.p_n[lev]);
+        clist.intersect(pn_ba);
+
+        BoxList new_bx;
+        clist.boxList(new_bx);
+        new_bx.refine(bf);
+        new_bx.simplify();
+
+        if (new_bx.isEmpty()) continue;
+
+        new_bx.refine(ref_ratio[lev]);
+
+        plan.new_finest = std::max(plan.new_finest, lev+1);
+        plan.new_grids[lev+1] = BoxArray(std::move(new_bx));
+        plan.new_grids[lev+1].maxSize(max_grid_size[lev+1]);
+    }
+}
+
+bool
+AmrCoreAdv::PlanCovers (const RegridPlan& plan, const RegridPlan& fresh) const
+{
+    for (int lev = fresh.lbase; lev <= fresh.max_crse; ++lev)
+    {
+        const auto& tags = fresh.tags[lev];
+        if (tags.empty()) continue;
+        if (lev+1 > plan.new_finest) return false;
+
+        BoxArray covered = plan.new_grids[lev+1];
+        covered.coarsen(ref_ratio[lev]*plan.bf_lev[lev]);
+
+        for (const IntVect& iv : tags) {
+            if (!covered.contains(iv)) return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,178 @@
+#include <AMReX_TagBox.H>
+#include <AMReX_ParallelDescriptor.H>
+
+#include <AmrCoreAdv.H>
+
+using namespace amrex;
+
+namespace {
+
+// add the periodic images of the boxes of bl that overlap domain
+void
+project_periodic (BoxList& bl, const Box& domain, const Periodicity& period)
+{
+    if (!period.isAnyPeriodic()) return;
+
+    BoxList images;
+    for (const auto& iv : period.shiftIntVect())
+    {
+        if (iv == IntVect::TheZeroVector()) continue;
+        for (const Box& b : bl) {
+            const Box& bs = amrex::shift(b, iv) & domain;
+            if (bs.ok()) images.push_back(bs);
+        }
+    }
+    bl.catenate(images);
+}
+
+}
+
+// Make the new grids of levels lbase+1 and up.
+//
+// With amr.block_grids, the finer levels are built octree style from fixed
+// blocks of block_size^DIM cells: the tags are coarsened so that one tag
+// marks one block, and every marked block that lies in the proper nesting
+// region becomes a grid. The cost is linear in the number of blocks and
+// all grids have the same shape. Otherwise AmrCore's clustering is used,
+// during Evolve with amr.async_regrid in the background (AsyncRegrid.cpp).
+//
+// overrides the virtual function in AmrMesh
+void
+AmrCoreAdv::MakeNewGrids (int lbase, Real time, int& new_finest, Vector<BoxArray>& new_grids)
+{
+    if (!block_grids) {
+        if (async_regrid && !regrid_plans.empty()) {
+            MakeNewGridsAsync(lbase, time, new_finest, new_grids);
+        } else {
+            AmrCore::MakeNewGrids(lbase, time, new_finest, new_grids);
+        }
+        return;
+    }
+
+    BL_PROFILE("AmrCoreAdv::MakeNewGrids()");
+
+    const Real strt_time = amrex::second();
+
+    // add at most one new level
+    const int max_crse = std::min(finest_level, max_level-1);
+
+    if (new_grids.size() < max_crse+2) new_grids.resize(max_crse+2);
+
+    for (int lev = 0; lev < max_level; ++lev) {
+        for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+            if (block_size % blocking_factor[lev+1][idim] != 0 || block_size % ref_ratio[lev][idim] != 0) {
+                amrex::Abort("amr.block_size must be a multiple of amr.blocking_factor and amr.ref_ratio");
+            }
+        }
+    }
+
+    Vector<IntVect> bf_lev;
+    Vector<BoxList> p_n;
+    NestingRegions(lbase, max_crse, bf_lev, p_n);
+
+    new_finest = lbase;
+    Long nblocks = 0;
+
+    for (int lev = max_crse; lev >= lbase; --lev)
+    {
+        // coarse cells per block
+        const IntVect bratio = IntVect(block_size) / ref_ratio[lev];
+
+        TagBoxArray tags(grids[lev], dmap[lev], n_error_buf[lev]);
+        ErrorEst(lev, tags, time, 0);
+
+        // the next finer level must be properly nested in the level we are making
+        if (lev+2 <= new_finest)
+        {
+            BoxArray ba_f = new_grids[lev+2];
+            ba_f.coarsen(ref_ratio[lev+1]);
+            ba_f.grow(n_proper);
+            ba_f.coarsen(ref_ratio[lev]);
+            tags.setVal(ba_f, TagBox::SET);
+        }
+
+        tags.buffer(n_error_buf[lev]);
+        tags.mapPeriodicRemoveDuplicates(geom[lev]);
+
+        // one tag per block
+        tags.coarsen(bratio);
+
+        Gpu::PinnedVector<IntVect> tagvec;
+        tags.collate(tagvec);
+
+        // every rank has all the tagged blocks; cut them to the nesting region
+        const BoxArray pn_ba(p_n[lev]);
+        const IntVect block_in_bf = bratio / bf_lev[lev];
+
+        BoxList new_bl;
+        std::vector<std::pair<int,Box> > isects;
+        for (const IntVect& iv : tagvec)
+        {
+            const Box& block = amrex::refine(Box(iv,iv), block_in_bf);
+            pn_ba.intersections(block, isects);
+            for (const auto& is : isects) {
+                new_bl.push_back(amrex::refine(is.second, bf_lev[lev]*ref_ratio[lev]));
+            }
+        }
+
+        if (new_bl.isEmpty()) continue;
+
+        nblocks += tagvec.size();
+
+        new_finest = std::max(new_finest, lev+1);
+
+        new_grids[lev+1] = BoxArray(std::move(new_bl));
+        new_grids[lev+1].maxSize(max_grid_size[lev+1]);
+    }
+
+    if (Verbose()) {
+        amrex::Print() << "Block grids: " << nblocks << " blocks of " << block_size
+                       << " cells on levels " << lbase+1 << " to " << new_finest
+                       << " in " << amrex::second() - strt_time << " s" << std::endl;
+    }
+}
+
+// in units of the blocking factor of the next finer level, so that every
+// box cut out of the nesting region is properly aligned
+void
+AmrCoreAdv::NestingRegions (int lbase, int max_crse, Vector<IntVect>& bf_lev,
+                            Vector<BoxList>& p_n) const
+{
+    bf_lev.resize(max_level);
+    Vector<Box> pc_domain(max_level);
+    for (int lev = 0; lev < max_level; ++lev) {
+        for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+            bf_lev[lev][idim] = std::max(1, blocking_factor[lev+1][idim]/ref_ratio[lev][idim]);
+        }
+        pc_domain[lev] = amrex::coarsen(geom[lev].Domain(), bf_lev[lev]);
+    }
+
+    // proper nesting regions, built from the complement of level lbase
+    // as in AmrMesh: cells at least n_proper cells away from a coarser
+    // cell that is not refined
+    p_n.clear();
+    p_n.resize(max_level);
+    Vector<BoxList> p_n_comp(max_level);
+
+    BoxList bl = grids[lbase].simplified_list();
+    bl.coarsen(bf_lev[lbase]);
+    p_n_comp[lbase].complementIn(pc_domain[lbase], bl);
+    p_n_comp[lbase].simplify();
+    p_n_comp[lbase].accrete(n_proper);
+    project_periodic(p_n_comp[lbase], pc_domain[lbase],
+                     geom[lbase].periodicity(pc_domain[lbase]));
+    p_n[lbase].complementIn(pc_domain[lbase], p_n_comp[lbase]);
+    p_n[lbase].simplify();
+
+    for (int lev = lbase+1; lev <= max_crse; ++lev)
+    {
+        p_n_comp[lev] = p_n_comp[lev-1];
+        p_n_comp[lev].simplify();
+        p_n_comp[lev].refine(bf_lev[lev-1]*ref_ratio[lev-1]/bf_lev[lev]);
+        p_n_comp[lev].accrete(n_proper);
+        project_periodic(p_n_comp[lev], pc_domain[lev],
+                         geom[lev].periodicity(pc_domain[lev]));
+        p_n[lev].complementIn(pc_domain[lev], p_n_comp[lev]);
+        p_n[lev].simplify();
+    }
+}
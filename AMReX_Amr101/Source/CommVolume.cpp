@@ -0,0 +1,151 @@
+#include <algorithm>
+
+#include <AMReX_ParallelDescriptor.H>
+
+#include <AmrCoreAdv.H>
+
+using namespace amrex;
+
+namespace {
+
+// number of cells of bx (and its periodic images) that live in boxes of
+// ba owned by a rank other than "owner", i.e. cells that have to be
+// sent over MPI to fill bx
+Long
+remote_cells (const Box& bx, int owner, const BoxArray& ba,
+              const DistributionMapping& dm, const Periodicity& period)
+{
+    Long ncells = 0;
+    std::vector<std::pair<int,Box> > isects;
+
+    for (const auto& iv : period.shiftIntVect())
+    {
+        ba.intersections(bx+iv, isects);
+        for (const auto& is : isects)
+        {
+            if (dm[is.first] != owner) {
+                ncells += is.second.numPts();
+            }
+        }
+    }
+    return ncells;
+}
+
+}
+
+// estimate the bytes this rank sends per advance of each level for the
+// ghost cell exchange, the coarse data for FillPatch and average down,
+// stored as vol[nterms*lev + term]
+//
+// the volumes are computed from the BoxArrays and DistributionMappings
+// alone (no messages are sent), counting every cell that the local boxes
+// need from a box owned by another rank
+void
+AmrCoreAdv::EstimateCommVolume (Vector<Long>& vol) const
+{
+    // must match the number of ghost cells used to advance phi
+    constexpr int num_grow = 3;
+
+    const int myproc = ParallelDescriptor::MyProc();
+    const int nlevs  = finest_level+1;
+
+    vol.assign(comm_nterms*nlevs, 0);
+
+    for (int lev = 0; lev <= finest_level; ++lev)
+    {
+        const BoxArray& ba = grids[lev];
+        const DistributionMapping& dm = dmap[lev];
+        const Periodicity& period = geom[lev].periodicity();
+
+        Long ghost_cells = 0;
+        Long fillpatch_cells = 0;
+        Long avgdown_cells = 0;
+
+        for (int i = 0; i < ba.size(); ++i)
+        {
+            if (dm[i] != myproc) continue;
+
+            // FillBoundary of the grown state at this level
+            ghost_cells += remote_cells(amrex::grow(ba[i],num_grow), myproc, ba, dm, period);
+
+            if (lev > 0)
+            {
+                const IntVect& rr = refRatio(lev-1);
+                const BoxArray& cba = grids[lev-1];
+                const DistributionMapping& cdm = dmap[lev-1];
+                const Periodicity& cperiod = geom[lev-1].periodicity();
+
+                // ghost cells not covered by this level are interpolated from
+                // coarse data (cell_cons_interp needs one extra coarse cell)
+                const Box& gbx = amrex::grow(ba[i],num_grow) & geom[lev].Domain();
+                const BoxList& uncovered = ba.complementIn(gbx);
+                for (const Box& b : uncovered) {
+                    fillpatch_cells += remote_cells(amrex::grow(amrex::coarsen(b,rr),1),
+                                                    myproc, cba, cdm, cperiod);
+                }
+
+                // averaging down sends the coarsened valid data to the coarse owner
+                avgdown_cells += remote_cells(amrex::coarsen(ba[i],rr), myproc, cba, cdm, cperiod);
+            }
+        }
+
+        const Long bytes_per_cell = phi_new[lev].nComp() * sizeof(Real);
+        vol[comm_nterms*lev  ] = ghost_cells     * bytes_per_cell;
+        vol[comm_nterms*lev+1] = fillpatch_cells * bytes_per_cell;
+        vol[comm_nterms*lev+2] = avgdown_cells   * bytes_per_cell;
+    }
+}
+
+// print the estimated per-level communication volume of the
+// ghost cell exchange, FillPatch and average down
+void
+AmrCoreAdv::ReportCommVolume () const
+{
+    constexpr int nterms = comm_nterms;
+
+    Vector<Long> vol_sum;
+    EstimateCommVolume(vol_sum);
+
+    Vector<Long> vol_max(vol_sum);
+    ParallelDescriptor::ReduceLongSum(vol_sum.data(), vol_sum.size());
+    ParallelDescriptor::ReduceLongMax(vol_max.data(), vol_max.size());
+
+    amrex::Print() << "\nEstimated communication volume per advance (bytes, total / max per rank)\n";
+    for (int lev = 0; lev <= finest_level; ++lev)
+    {
+        // number of distinct ranks this level lives on
+        Vector<int> pmap = dmap[lev].ProcessorMap();
+        std::sort(pmap.begin(), pmap.end());
+        const auto nranks = std::distance(pmap.begin(), std::unique(pmap.begin(), pmap.end()));
+
+        amrex::Print() << "  Level " << lev << ": " << grids[lev].size() << " boxes on "
+                       << nranks << " ranks"
+                       << "  FillBoundary " << vol_sum[nterms*lev  ] << " / " << vol_max[nterms*lev  ]
+                       << "  FillPatch "    << vol_sum[nterms*lev+1] << " / " << vol_max[nterms*lev+1]
+                       << "  AverageDown "  << vol_sum[nterms*lev+2] << " / " << vol_max[nterms*lev+2]
+                       << "\n";
+    }
+}
+
+// print the communication volume and/or update the telemetry after the grids change
+void
+AmrCoreAdv::PostRegrid ()
+{
+    if (comm_report) {
+        ReportCommVolume();
+    }
+
+    if (telemetry)
+    {
+        Vector<Long> vol;
+        EstimateCommVolume(vol);
+
+        Vector<Long> fillpatch_bytes(finest_level+1);
+        Vector<Long> avgdown_bytes(finest_level+1);
+        for (int lev = 0; lev <= finest_level; ++lev) {
+            fillpatch_bytes[lev] = vol[comm_nterms*lev] + vol[comm_nterms*lev+1];
+            avgdown_bytes[lev]   = vol[comm_nterms*lev+2];
+        }
+        telemetry->SetCommEstimate(fillpatch_bytes, avgdown_bytes);
+    }
+}
@@ -1,5 +1,6 @@
 #include <AmrCoreAdv.H>
 #include <Kernels.H>
+#include <AdvectTile.H>
 
 #include <AMReX_MultiFabUtil.H>
 
@@ -11,6 +12,19 @@ AmrCoreAdv::DefineVelocityAllLevels (Real time)
     for (int lev = 0; lev <= finest_level; ++lev)
         DefineVelocityAtLevel(lev,time);
 
+    // with adv.lean there are no face velocities to average down; the faces
+    // under the finer level are averaged from its stream function instead
+    // whenever LeanFaceVelocity computes them
+    if (lean) {
+        for (int lev = 0; lev < finest_level; ++lev)
+        {
+            lean_avg_crse_fine[lev] = amrex::coarsen(grids[lev+1], refRatio(lev));
+            lean_avg_time[lev] = time;
+            ClassifyLeanVelocity(lev);
+        }
+        return;
+    }
+
     // =======================================================
     // Average down face velocities before using them
     // =======================================================
@@ -20,11 +34,23 @@ AmrCoreAdv::DefineVelocityAllLevels (Real time)
                            amrex::GetArrOfPtrs     (facevel[lev-1]),
                            MaxRefRatio(lev-1), 0);
     }
+
+    // the averaged coarse velocities are what the advance uses
+    for (int lev = 0; lev < finest_level; ++lev)
+    {
+        classify_velocity(facevel[lev], vel_props[lev], 1);
+        vel_level_props[lev] = common_vel_props(vel_props[lev]);
+    }
 }
 
 void
 AmrCoreAdv::DefineVelocityAtLevel (int lev, Real time)
 {
+    if (lean) {
+        DefineStreamFunction(lev, time);
+        return;
+    }
+
     const auto dx = geom[lev].CellSizeArray();
     const Real* prob_lo = geom[lev].ProbLo();
 
@@ -90,4 +116,73 @@ AmrCoreAdv::DefineVelocityAtLevel (int lev, Real time)
                         );
         }
     }
+
+    // find which kernel variants are exact for this velocity
+    classify_velocity(facevel[lev], vel_props[lev], 1);
+    vel_level_props[lev] = common_vel_props(vel_props[lev]);
+}
+
+// Define the face velocities of level lev on the faces of the valid boxes
+// grown by ngrow, writing into vel instead of facevel
+void
+AmrCoreAdv::DefineGrownVelocity (int lev, Real time,
+                                 Array<MultiFab, AMREX_SPACEDIM>& vel, int ngrow)
+{
+    GeometryData geomdata = geom[lev].data();
+    auto prob_lo = geom[lev].ProbLoArray();
+    auto dx = geom[lev].CellSizeArray();
+
+#ifdef _OPENMP
+#pragma omp parallel if (Gpu::notInLaunchRegion())
+#endif
+    {
+        for (MFIter mfi(phi_new[lev],TilingIfNotGPU()); mfi.isValid(); ++mfi)
+        {
+            // grown only at the box boundaries, so tiles do not overlap
+            AMREX_D_TERM(const Box& ngbxx = mfi.grownnodaltilebox(0,ngrow);,
+                         const Box& ngbxy = mfi.grownnodaltilebox(1,ngrow);,
+                         const Box& ngbxz = mfi.grownnodaltilebox(2,ngrow););
+
+            GpuArray<Array4<Real>, AMREX_SPACEDIM> velarr{ AMREX_D_DECL( vel[0].array(mfi),
+                                                                         vel[1].array(mfi),
+                                                                         vel[2].array(mfi)) };
+
+            // the stream function is 2D and needs one extra cell around the faces
+            Box psibox = amrex::grow(mfi.growntilebox(ngrow), 1);
+#if (AMREX_SPACEDIM > 2)
+            psibox.setSmall(2, 0);
+            psibox.setBig(2, 0);
+#endif
+
+            FArrayBox psifab(psibox, 1);
+            Elixir psieli = psifab.elixir();
+            Array4<Real> psi = psifab.array();
+
+            amrex::launch(psibox,
+            [=] AMREX_GPU_DEVICE (const Box& tbx)
+            {
+                get_face_velocity_psi(tbx, time, psi, geomdata); 
+            });
+
+            AMREX_D_TERM(
+                         amrex::ParallelFor(ngbxx,
+                         [=] AMREX_GPU_DEVICE (int i, int j, int k)
+                         {
+                             get_face_velocity_x(i, j, k, velarr[0], psi, prob_lo, dx); 
+                         });,
+
+                         amrex::ParallelFor(ngbxy,
+                         [=] AMREX_GPU_DEVICE (int i, int j, int k)
+                         {
+                             get_face_velocity_y(i, j, k, velarr[1], psi, prob_lo, dx);
+                         });,
+
+                         amrex::ParallelFor(ngbxz,
+                         [=] AMREX_GPU_DEVICE (int i, int j, int k)
+                         {
+                             get_face_velocity_z(i, j, k, velarr[2], psi, prob_lo, dx);
+                         });
+                        );
+        }
+    }
 }
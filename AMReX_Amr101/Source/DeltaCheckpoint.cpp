@@ -0,0 +1,305 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <type_traits>
+
+#include <AMReX_ParallelDescriptor.H>
+#include <AMReX_Utility.H>
+#include <AMReX_VisMF.H>
+
+#include <AmrCoreAdv.H>
+
+using namespace amrex;
+
+// Differential checkpoints (amr.chk_base_int > 1).
+//
+// A delta checkpoint has the usual Header plus a file Delta holding the
+// name of the checkpoint it follows (in the same directory) and, per level, whether the level was
+// written in full (new or regridded level) or as a delta. A delta level
+// holds, in Level_<lev>/delta_<rank>, the fabs that changed since the
+// previous checkpoint as the XOR of their old and new words with the runs
+// of zero words removed, and in Level_<lev>/DeltaIndex where each fab's
+// record is, its length and the FNV-1a hash of its new content.
+
+namespace {
+
+using Word = std::conditional<sizeof(Real) == 8, std::uint64_t, std::uint32_t>::type;
+
+// 64 bit FNV-1a
+std::uint64_t
+fnv1a (const void* data, std::size_t n)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    std::uint64_t h = 14695981039346656037ull;
+    for (std::size_t i = 0; i < n; ++i) {
+        h = (h ^ p[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+// XOR of new and old as (zero run, literal count, literals...) records;
+// returns false if the two are identical
+bool
+xor_encode (const Real* cur, const Real* old, Long n, std::vector<Word>& out)
+{
+    out.clear();
+    bool changed = false;
+    Long i = 0;
+    while (i < n)
+    {
+        Word zeros = 0;
+        Word w = 0;
+        for (; i < n; ++i) {
+            Word a, b;
+            std::memcpy(&a, cur+i, sizeof(Word));
+            std::memcpy(&b, old+i, sizeof(Word));
+            w = a ^ b;
+            if (w != 0) break;
+            ++zeros;
+        }
+        out.push_back(zeros);
+        const std::size_t count_pos = out.size();
+        out.push_back(0);
+        for (; i < n; ++i) {
+            Word a, b;
+            std::memcpy(&a, cur+i, sizeof(Word));
+            std::memcpy(&b, old+i, sizeof(Word));
+            w = a ^ b;
+            if (w == 0) break;
+            out.push_back(w);
+            ++out[count_pos];
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void
+xor_decode (Real* data, Long n, const std::vector<Word>& in)
+{
+    Long i = 0;
+    std::size_t k = 0;
+    while (k < in.size())
+    {
+        i += in[k++];
+        const Word count = in[k++];
+        for (Word c = 0; c < count; ++c, ++i, ++k) {
+            AMREX_ALWAYS_ASSERT(i < n);
+            Word a;
+            std::memcpy(&a, data+i, sizeof(Word));
+            a ^= in[k];
+            std::memcpy(data+i, &a, sizeof(Word));
+        }
+    }
+}
+
+std::string
+level_dir (const std::string& chkname, int lev)
+{
+    return chkname + "/Level_" + std::to_string(lev);
+}
+
+}
+
+// write level lev of checkpoint chkname as the difference to the previous
+// checkpoint, returns the bytes written by all ranks
+Long
+AmrCoreAdv::WriteLevelDelta (int lev, const std::string& chkname) const
+{
+    const MultiFab& mf = phi_new[lev];
+    const int nfabs = grids[lev].size();
+    const int myproc = ParallelDescriptor::MyProc();
+    const std::string file = level_dir(chkname, lev) + "/delta_" + std::to_string(myproc);
+
+    // rank, offset, bytes and hash of each fab, filled for the local fabs
+    Vector<Long> index(4*nfabs, 0);
+
+    std::ofstream ofs;
+    Long offset = 0;
+    std::vector<Word> enc;
+
+    for (MFIter mfi(mf); mfi.isValid(); ++mfi)
+    {
+        const int i = mfi.index();
+
+        FArrayBox cur(mf[mfi].box(), mf.nComp(), The_Pinned_Arena());
+        cur.copy<RunOn::Device>(mf[mfi]);
+        Gpu::streamSynchronize();
+
+        const std::uint64_t h = fnv1a(cur.dataPtr(), cur.nBytes());
+        index[4*i]   = myproc;
+        std::memcpy(&index[4*i+3], &h, sizeof(h));
+
+        if (!xor_encode(cur.dataPtr(), chk_last[lev][mfi].dataPtr(), cur.size(), enc)) continue;
+
+        if (!ofs.is_open()) {
+            ofs.open(file.c_str(), std::ios::binary | std::ios::trunc);
+            if (!ofs.good()) {
+                amrex::FileOpenFailed(file);
+            }
+        }
+        const Long bytes = enc.size()*sizeof(Word);
+        ofs.write(reinterpret_cast<const char*>(enc.data()), bytes);
+        index[4*i+1] = offset;
+        index[4*i+2] = bytes;
+        offset += bytes;
+    }
+
+    ParallelDescriptor::ReduceLongSum(index.data(), index.size());
+
+    Long total = 0;
+    for (int i = 0; i < nfabs; ++i) {
+        total += index[4*i+2];
+    }
+
+    if (ParallelDescriptor::IOProcessor())
+    {
+        const std::string indexfile = level_dir(chkname, lev) + "/DeltaIndex";
+        std::ofstream ifs(indexfile.c_str(), std::ios::trunc);
+        if (!ifs.good()) {
+            amrex::FileOpenFailed(indexfile);
+        }
+        ifs << nfabs << "\n";
+        for (int i = 0; i < nfabs; ++i) {
+            ifs << index[4*i] << " " << index[4*i+1] << " " << index[4*i+2] << " "
+                << static_cast<std::uint64_t>(index[4*i+3]) << "\n";
+        }
+        total += ifs.tellp();
+    }
+
+    return total;
+}
+
+// apply the delta of level lev in checkpoint chkname to phi_new[lev],
+// which holds the level as of the previous checkpoint of the chain
+void
+AmrCoreAdv::ReadLevelDelta (int lev, const std::string& chkname)
+{
+    MultiFab& mf = phi_new[lev];
+    const std::string dir = level_dir(chkname, lev);
+
+    Vector<char> fileCharPtr;
+    ParallelDescriptor::ReadAndBcastFile(dir + "/DeltaIndex", fileCharPtr);
+    std::istringstream is(fileCharPtr.dataPtr());
+
+    int nfabs;
+    is >> nfabs;
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(nfabs == grids[lev].size(), "delta checkpoint does not match the level's grids");
+
+    Vector<int> rank(nfabs);
+    Vector<Long> offset(nfabs), bytes(nfabs);
+    Vector<std::uint64_t> hash(nfabs);
+    for (int i = 0; i < nfabs; ++i) {
+        is >> rank[i] >> offset[i] >> bytes[i] >> hash[i];
+    }
+
+    std::map<int, std::ifstream> files;
+    std::vector<Word> enc;
+
+    for (MFIter mfi(mf); mfi.isValid(); ++mfi)
+    {
+        const int i = mfi.index();
+
+        FArrayBox cur(mf[mfi].box(), mf.nComp(), The_Pinned_Arena());
+        cur.copy<RunOn::Device>(mf[mfi]);
+        Gpu::streamSynchronize();
+
+        if (bytes[i] > 0)
+        {
+            std::ifstream& ifs = files[rank[i]];
+            if (!ifs.is_open()) {
+                const std::string file = dir + "/delta_" + std::to_string(rank[i]);
+                ifs.open(file.c_str(), std::ios::binary);
+                if (!ifs.good()) {
+                    amrex::FileOpenFailed(file);
+                }
+            }
+            enc.resize(bytes[i]/sizeof(Word));
+            ifs.seekg(offset[i]);
+            ifs.read(reinterpret_cast<char*>(enc.data()), bytes[i]);
+
+            xor_decode(cur.dataPtr(), cur.size(), enc);
+            mf[mfi].copy<RunOn::Device>(cur);
+            Gpu::streamSynchronize();
+        }
+
+        if (fnv1a(cur.dataPtr(), cur.nBytes()) != hash[i]) {
+            amrex::Abort("delta checkpoint " + chkname + ": level " + std::to_string(lev)
+                         + " fab " + std::to_string(i) + " does not match its hash");
+        }
+    }
+}
+
+// keep a host copy of phi as of this checkpoint for the next delta
+void
+AmrCoreAdv::SaveCheckpointState (const std::string& chkname)
+{
+    chk_last.resize(finest_level+1);
+    for (int lev = 0; lev <= finest_level; ++lev)
+    {
+        if (!(chk_last[lev].boxArray() == grids[lev]) || !(chk_last[lev].DistributionMap() == dmap[lev])) {
+            chk_last[lev].define(grids[lev], dmap[lev], phi_new[lev].nComp(), 0,
+                                 MFInfo().SetArena(The_Pinned_Arena()));
+        }
+        MultiFab::Copy(chk_last[lev], phi_new[lev], 0, 0, phi_new[lev].nComp(), 0);
+    }
+    Gpu::streamSynchronize();
+    chk_last_name = chkname;
+}
+
+// whether level lev can be written as a delta of the last checkpoint
+bool
+AmrCoreAdv::CanWriteDelta (int lev) const
+{
+    return lev < chk_last.size()
+        && chk_last[lev].boxArray() == grids[lev]
+        && chk_last[lev].DistributionMap() == dmap[lev];
+}
+
+// the checkpoints restart_chkfile builds on, oldest first, and which levels
+// each of them holds in full
+void
+AmrCoreAdv::ReadCheckpointChain (Vector<std::string>& chain, Vector<Vector<int> >& full) const
+{
+    chain.clear();
+    full.clear();
+
+    std::string name = restart_chkfile;
+    while (name.size() > 1 && name.back() == '/') {
+        name.pop_back();
+    }
+    while (true)
+    {
+        chain.insert(chain.begin(), name);
+        if (!amrex::FileExists(name + "/Delta")) {
+            // a full checkpoint
+            full.insert(full.begin(), Vector<int>(max_level+1, 1));
+            break;
+        }
+
+        Vector<char> fileCharPtr;
+        ParallelDescriptor::ReadAndBcastFile(name + "/Delta", fileCharPtr);
+        std::istringstream is(fileCharPtr.dataPtr());
+
+        std::string parent, line;
+        std::getline(is, parent);
+        std::getline(is, line);
+        std::istringstream lis(line);
+        Vector<int> f;
+        int m;
+        while (lis >> m) {
+            f.push_back(m);
+        }
+        full.insert(full.begin(), f);
+
+        // the parent is in the directory of this checkpoint, wherever we run from
+        // (older Delta files may hold the parent's path as written)
+        if (parent.empty() || parent[0] != '/') {
+            parent = name.substr(0, name.find_last_of('/') + 1)
+                   + parent.substr(parent.find_last_of('/') + 1);
+        }
+        name = parent;
+    }
+}
@@ -0,0 +1,201 @@
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+#include <AMReX_ParallelDescriptor.H>
+#include <AMReX_Print.H>
+#include <AMReX_Utility.H>
+
+#include <Diagnostics.H>
+
+using namespace amrex;
+
+Diagnostics::Diagnostics (const std::string& filename, int level, int interval, int nlevs)
+    : m_level(level),
+      m_interval(interval),
+      m_nlevs(nlevs),
+      m_last_cells(nlevs, 0)
+{
+    Reset(m_fill);
+    Reset(m_flight);
+
+    if (ParallelDescriptor::IOProcessor()) {
+        m_ofs.open(filename.c_str(), std::ios::out | std::ios::trunc);
+        if (!m_ofs.good()) {
+            amrex::FileOpenFailed(filename);
+        }
+        m_ofs << std::setprecision(12);
+
+        m_ofs << "step,time,dt";
+        if (m_level >= 1) m_ofs << ",sum_phi,wall_time";
+        if (m_level >= 2) m_ofs << ",min_phi,max_phi";
+        if (m_level >= 3) {
+            for (int lev = 0; lev < m_nlevs; ++lev) {
+                m_ofs << ",cells_" << lev;
+            }
+        }
+        m_ofs << "\n";
+    }
+}
+
+Diagnostics::~Diagnostics ()
+{
+    // a run that did not call Finalize must not leave requests pending
+    if (m_in_flight) {
+        CompleteReduction();
+    }
+}
+
+void
+Diagnostics::Reset (Buffer& b)
+{
+    const int n = m_interval;
+    b.nrec = 0;
+    b.step.resize(n);
+    b.time.resize(n);
+    b.dt.resize(n);
+    b.cells.resize((m_level >= 3) ? n*m_nlevs : 0);
+    b.sum.resize((m_level >= 1) ? n : 0);
+    b.min.resize((m_level >= 2) ? n : 0);
+    b.max.resize((m_level >= 2) ? 2*n : (m_level >= 1) ? n : 0);
+}
+
+void
+Diagnostics::BeginStep ()
+{
+    if (m_level >= 1) {
+        m_step_start = amrex::second();
+    }
+}
+
+void
+Diagnostics::EndStep (int step, Real time, Real dt, int finest_level,
+                      const Vector<MultiFab>& phi, const Vector<Long>& cells)
+{
+    Buffer& b = m_fill;
+    const int r = b.nrec;
+
+    b.step[r] = step;
+    b.time[r] = time;
+    b.dt[r] = dt;
+
+    // rank local values only; the reductions are batched
+    if (m_level >= 1) {
+        b.sum[r] = phi[0].sum(0, true);
+        b.max[r] = amrex::second() - m_step_start;
+    }
+    if (m_level >= 2) {
+        Real mn = std::numeric_limits<Real>::max();
+        Real mx = std::numeric_limits<Real>::lowest();
+        for (int lev = 0; lev <= finest_level; ++lev) {
+            mn = amrex::min(mn, phi[lev].min(0, 0, true));
+            mx = amrex::max(mx, phi[lev].max(0, 0, true));
+        }
+        b.min[r] = mn;
+        b.max[m_interval + r] = mx;
+    }
+    if (m_level >= 3) {
+        for (int lev = 0; lev < m_nlevs; ++lev) {
+            b.cells[r*m_nlevs + lev] = cells[lev] - m_last_cells[lev];
+            m_last_cells[lev] = cells[lev];
+        }
+    }
+
+    if (++b.nrec == m_interval) {
+        StartReduction();
+    }
+}
+
+void
+Diagnostics::StartReduction ()
+{
+    // the previous batch has had a whole interval to complete
+    if (m_in_flight) {
+        CompleteReduction();
+    }
+
+    std::swap(m_fill, m_flight);
+    Reset(m_fill);
+
+#ifdef BL_USE_MPI
+    const MPI_Comm comm = ParallelDescriptor::Communicator();
+    const int ioproc = ParallelDescriptor::IOProcessorNumber();
+    const bool root = ParallelDescriptor::IOProcessor();
+    const MPI_Datatype type = ParallelDescriptor::Mpi_typemap<Real>::type();
+
+    // reduced in place on the I/O rank
+    Vector<Real>* bufs[3] = {&m_flight.sum, &m_flight.min, &m_flight.max};
+    const MPI_Op ops[3] = {MPI_SUM, MPI_MIN, MPI_MAX};
+    for (int i = 0; i < 3; ++i)
+    {
+        m_req[i] = MPI_REQUEST_NULL;
+        Vector<Real>& v = *bufs[i];
+        if (v.empty()) continue;
+        MPI_Ireduce(root ? MPI_IN_PLACE : v.data(), root ? v.data() : nullptr,
+                    v.size(), type, ops[i], ioproc, comm, &m_req[i]);
+    }
+#endif
+
+    m_in_flight = true;
+}
+
+void
+Diagnostics::CompleteReduction ()
+{
+#ifdef BL_USE_MPI
+    MPI_Waitall(3, m_req, MPI_STATUSES_IGNORE);
+#endif
+    m_in_flight = false;
+
+    const Buffer& b = m_flight;
+    if (!ParallelDescriptor::IOProcessor() || b.nrec == 0) return;
+
+    Real wall = 0.0;
+    Real mn = std::numeric_limits<Real>::max();
+    Real mx = std::numeric_limits<Real>::lowest();
+
+    for (int r = 0; r < b.nrec; ++r)
+    {
+        m_ofs << b.step[r] << "," << b.time[r] << "," << b.dt[r];
+        if (m_level >= 1) {
+            m_ofs << "," << b.sum[r] << "," << b.max[r];
+            wall += b.max[r];
+        }
+        if (m_level >= 2) {
+            m_ofs << "," << b.min[r] << "," << b.max[m_interval + r];
+            mn = amrex::min(mn, b.min[r]);
+            mx = amrex::max(mx, b.max[m_interval + r]);
+        }
+        if (m_level >= 3) {
+            for (int lev = 0; lev < m_nlevs; ++lev) {
+                m_ofs << "," << b.cells[r*m_nlevs + lev];
+            }
+        }
+        m_ofs << "\n";
+    }
+    m_ofs.flush();
+
+    const int last = b.nrec - 1;
+    std::ostringstream ss;
+    ss << "Coarse STEPs " << b.step[0] << " to " << b.step[last]
+       << " TIME = " << b.time[last] << " DT = " << b.dt[last];
+    if (m_level >= 1) {
+        ss << " Sum(Phi) = " << b.sum[last] << " wall time = " << wall;
+    }
+    if (m_level >= 2) {
+        ss << " min/max(Phi) = " << mn << " " << mx;
+    }
+    amrex::Print() << ss.str() << std::endl;
+}
+
+void
+Diagnostics::Finalize ()
+{
+    if (m_in_flight) {
+        CompleteReduction();
+    }
+    if (m_fill.nrec > 0) {
+        StartReduction();
+        CompleteReduction();
+    }
+}
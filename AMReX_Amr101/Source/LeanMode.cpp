@@ -0,0 +1,259 @@
+#include <AMReX_BaseFab.H>
+#include <AMReX_ParallelDescriptor.H>
+
+#include <AmrCoreAdv.H>
+#include <AdvectTile.H>
+#include <Kernels.H>
+
+using namespace amrex;
+
+namespace {
+
+// bytes of the fabs this rank owns
+Long
+owned_bytes (const MultiFab& mf)
+{
+    if (mf.empty()) return 0;
+
+    Long bytes = 0;
+    for (MFIter mfi(mf); mfi.isValid(); ++mfi) {
+        bytes += mf[mfi].nBytes();
+    }
+    return bytes;
+}
+
+}
+
+// With adv.lean, facevel is not stored. Instead the stream function of
+// each box (2D, so much smaller than the three face velocity MultiFabs)
+// is cached, and the face velocities of a tile are computed from it when
+// needed. Also classifies the velocity and records its maximum, which
+// DefineVelocityAtLevel and the facevel norms provide otherwise.
+void
+AmrCoreAdv::DefineStreamFunction (int lev, Real time)
+{
+    // like a redefined facevel, not averaged down until DefineVelocityAllLevels
+    lean_avg_crse_fine[lev] = BoxArray();
+
+    // every box grown by one face, plus the cell the differences of psi need
+    BoxList bl;
+    for (int i = 0; i < grids[lev].size(); ++i)
+    {
+        Box b = amrex::grow(grids[lev][i], 2);
+#if (AMREX_SPACEDIM > 2)
+        b.setSmall(2, 0);
+        b.setBig(2, 0);
+#endif
+        bl.push_back(b);
+    }
+    const BoxArray psi_ba(std::move(bl));
+
+    if (!(psi_cache[lev].boxArray() == psi_ba) || !(psi_cache[lev].DistributionMap() == dmap[lev])) {
+        psi_cache[lev].define(psi_ba, dmap[lev], 1, 0);
+    }
+
+    const GeometryData geomdata = geom[lev].data();
+
+    for (MFIter mfi(psi_cache[lev]); mfi.isValid(); ++mfi)
+    {
+        Array4<Real> psi = psi_cache[lev].array(mfi);
+        amrex::launch(mfi.validbox(),
+        [=] AMREX_GPU_DEVICE (const Box& tbx)
+        {
+            get_face_velocity_psi(tbx, time, psi, geomdata);
+        });
+    }
+
+    ClassifyLeanVelocity(lev);
+}
+
+void
+AmrCoreAdv::ClassifyLeanVelocity (int lev)
+{
+    vel_props[lev].define(grids[lev], dmap[lev]);
+    lean_umax[lev].fill(0.0);
+
+    for (MFIter mfi(phi_new[lev]); mfi.isValid(); ++mfi)
+    {
+        const Box& bx = mfi.validbox();
+
+        Array<FArrayBox, AMREX_SPACEDIM> velfab;
+        LeanFaceVelocity(lev, bx, bx, psi_cache[lev][mfi], velfab);
+
+        Array<FArrayBox const*, AMREX_SPACEDIM> fabs{AMREX_D_DECL(&velfab[0], &velfab[1], &velfab[2])};
+        vel_props[lev][mfi] = classify_fab_velocity(fabs, bx, 1);
+
+        for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+            const Real umax = velfab[idim].maxabs<RunOn::Device>(amrex::surroundingNodes(bx, idim), 0);
+            lean_umax[lev][idim] = amrex::max(lean_umax[lev][idim], umax);
+        }
+    }
+
+    vel_level_props[lev] = common_vel_props(vel_props[lev]);
+}
+
+// face velocities on the faces of bx and one face around it, from the
+// cached stream function of the box validbx that contains bx. The faces
+// of validbx under the finer level are then replaced by the mean of the
+// fine faces over them, computed from the fine stream function, as
+// average_down_faces replaces those of facevel without adv.lean.
+void
+AmrCoreAdv::LeanFaceVelocity (int lev, const Box& bx, const Box& validbx, FArrayBox& psifab,
+                              Array<FArrayBox, AMREX_SPACEDIM>& vel)
+{
+    const auto prob_lo = geom[lev].ProbLoArray();
+    const auto dx = geom[lev].CellSizeArray();
+    Array4<Real> psi = psifab.array();
+
+    GpuArray<Array4<Real>, AMREX_SPACEDIM> v;
+    for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+        vel[idim].resize(amrex::grow(amrex::surroundingNodes(bx, idim), 1), 1);
+        v[idim] = vel[idim].array();
+    }
+
+    AMREX_D_TERM(
+                 amrex::ParallelFor(vel[0].box(),
+                 [=] AMREX_GPU_DEVICE (int i, int j, int k)
+                 {
+                     get_face_velocity_x(i, j, k, v[0], psi, prob_lo, dx);
+                 });,
+
+                 amrex::ParallelFor(vel[1].box(),
+                 [=] AMREX_GPU_DEVICE (int i, int j, int k)
+                 {
+                     get_face_velocity_y(i, j, k, v[1], psi, prob_lo, dx);
+                 });,
+
+                 amrex::ParallelFor(vel[2].box(),
+                 [=] AMREX_GPU_DEVICE (int i, int j, int k)
+                 {
+                     get_face_velocity_z(i, j, k, v[2], psi, prob_lo, dx);
+                 });
+                );
+
+    const BoxArray& cfba = lean_avg_crse_fine[lev];
+    if (cfba.empty()) return;
+
+    const IntVect rr = refRatio(lev);
+    const GeometryData fgeomdata = geom[lev+1].data();
+    const auto fprob_lo = geom[lev+1].ProbLoArray();
+    const auto fdx = geom[lev+1].CellSizeArray();
+    const Real ftime = lean_avg_time[lev];
+
+    for (const auto& isect : cfba.intersections(amrex::grow(validbx, 1)))
+    {
+        const Box& cbox = cfba[isect.first];
+        for (int idim = 0; idim < AMREX_SPACEDIM; ++idim)
+        {
+            const Box cbx = amrex::surroundingNodes(cbox, idim) & amrex::surroundingNodes(validbx, idim)
+                            & vel[idim].box();
+            if (!cbx.ok()) continue;
+
+            // the fine faces over cbx and the fine stream function they need
+            const Box fbx = amrex::refine(cbx, rr);
+            Box pbx = amrex::grow(amrex::convert(fbx, IntVect::TheCellVector()), 1);
+#if (AMREX_SPACEDIM > 2)
+            pbx.setSmall(2, 0);
+            pbx.setBig(2, 0);
+#endif
+            FArrayBox fpsi(pbx, 1);
+            FArrayBox fvel(fbx, 1);
+            Elixir fpsi_eli = fpsi.elixir();
+            Elixir fvel_eli = fvel.elixir();
+            Array4<Real> fp = fpsi.array();
+            Array4<Real> fv = fvel.array();
+
+            amrex::launch(pbx,
+            [=] AMREX_GPU_DEVICE (const Box& tbx)
+            {
+                get_face_velocity_psi(tbx, ftime, fp, fgeomdata);
+            });
+
+            amrex::ParallelFor(fbx,
+            [=] AMREX_GPU_DEVICE (int i, int j, int k)
+            {
+                AMREX_D_TERM(if (idim == 0) get_face_velocity_x(i, j, k, fv, fp, fprob_lo, fdx);,
+                             if (idim == 1) get_face_velocity_y(i, j, k, fv, fp, fprob_lo, fdx);,
+                             if (idim == 2) get_face_velocity_z(i, j, k, fv, fp, fprob_lo, fdx););
+            });
+
+            // the mean of the fine faces on each coarse face
+            const int n0 = (idim == 0) ? 1 : rr[0];
+            const int n1 = (idim == 1) ? 1 : rr[1];
+            const int n2 = (AMREX_SPACEDIM < 3 || idim == 2) ? 1 : rr[AMREX_SPACEDIM-1];
+            const Real facinv = 1.0 / (n0*n1*n2);
+            Array4<Real> const& vc = v[idim];
+            AMREX_D_TERM(const int r0 = rr[0];, const int r1 = rr[1];, const int r2 = rr[2];);
+
+            amrex::ParallelFor(cbx,
+            [=] AMREX_GPU_DEVICE (int i, int j, int k)
+            {
+                Real sum = 0.0;
+                for (int kk = 0; kk < n2; ++kk) {
+                for (int jj = 0; jj < n1; ++jj) {
+                for (int ii = 0; ii < n0; ++ii) {
+                    sum += fv(i*r0 + ii, j*r1 + jj, AMREX_D_PICK(0, 0, k*r2 + kk));
+                }}}
+                vc(i, j, k) = sum * facinv;
+            });
+        }
+    }
+}
+
+// max norm of the face velocity of level lev in direction idim
+Real
+AmrCoreAdv::MaxFaceVelocity (int lev, int idim, bool local) const
+{
+    if (!lean) {
+        return facevel[lev][idim].norm0(0, 0, local);
+    }
+
+    Real umax = lean_umax[lev][idim];
+    if (!local) {
+        ParallelDescriptor::ReduceRealMax(umax);
+    }
+    return umax;
+}
+
+// bytes this rank holds for level lev between steps
+Long
+AmrCoreAdv::LevelBytes (int lev) const
+{
+    Long bytes = owned_bytes(phi_new[lev]) + owned_bytes(phi_old[lev]) + owned_bytes(psi_cache[lev]);
+    for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+        bytes += owned_bytes(facevel[lev][idim]);
+    }
+    return bytes;
+}
+
+// update the high-water marks of level lev with the temporaries of its advance
+void
+AmrCoreAdv::RecordLevelMemory (int lev, const MultiFab& state,
+                               const Array<MultiFab, AMREX_SPACEDIM>& fluxes)
+{
+    Long bytes = LevelBytes(lev) + owned_bytes(state);
+    for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
+        bytes += owned_bytes(fluxes[idim]);
+    }
+    mem_level_hwm[lev] = std::max(mem_level_hwm[lev], bytes);
+    mem_total_hwm = std::max(mem_total_hwm, amrex::TotalBytesAllocatedInFabs());
+}
+
+void
+AmrCoreAdv::ReportMemory () const
+{
+    Vector<Long> hwm(mem_level_hwm);
+    hwm.push_back(mem_total_hwm);
+    ParallelDescriptor::ReduceLongMax(hwm.data(), hwm.size());
+
+    constexpr Real mb = 1.0/(1024.0*1024.0);
+
+    amrex::Print() << "\nMemory high-water marks (MB, max over ranks)"
+                   << (lean ? ", lean mode" : "") << "\n";
+    for (int lev = 0; lev <= max_level; ++lev)
+    {
+        if (hwm[lev] == 0) continue;
+        amrex::Print() << "  Level " << lev << ": " << hwm[lev]*mb << "\n";
+    }
+    amrex::Print() << "  All fabs: " << hwm.back()*mb << "\n";
+}
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cmath>
+
+#include <AMReX_MultiFabUtil.H>
+#include <AMReX_ParmParse.H>
+#include <AMReX_PlotFileUtil.H>
+
+#include <AmrCoreAdv.H>
+
+using namespace amrex;
+
+// read the named plotfile streams listed in amr.plot_views, e.g.
+//   amr.plot_views   = fine
+//   plot.fine.int    = 1
+//   plot.fine.lo     = 0.25 0.25 0.0
+//   plot.fine.hi     = 0.75 0.75 1.0
+//   plot.fine.lev_min = 1
+void
+AmrCoreAdv::ReadPlotViews ()
+{
+    Vector<std::string> names;
+    {
+        ParmParse pp("amr");
+        pp.queryarr("plot_views", names);
+    }
+
+    for (const auto& name : names)
+    {
+        ParmParse pp("plot." + name);
+
+        PlotView v;
+        v.name = name;
+        v.file = plot_file + "_" + name;
+        v.region = geom[0].ProbDomain();
+        v.lev_max = max_level;
+
+        pp.query("file", v.file);
+        pp.query("int", v.interval);
+        pp.query("lev_min", v.lev_min);
+        pp.query("lev_max", v.lev_max);
+        pp.query("coarsen", v.coarsen);
+
+        Vector<Real> lo, hi;
+        if (pp.queryarr("lo", lo)) {
+            AMREX_ALWAYS_ASSERT_WITH_MESSAGE(lo.size() == AMREX_SPACEDIM, "plot.<view>.lo needs AMREX_SPACEDIM values");
+            v.region.setLo(lo.data());
+        }
+        if (pp.queryarr("hi", hi)) {
+            AMREX_ALWAYS_ASSERT_WITH_MESSAGE(hi.size() == AMREX_SPACEDIM, "plot.<view>.hi needs AMREX_SPACEDIM values");
+            v.region.setHi(hi.data());
+        }
+
+        const Vector<std::string>& all_vars = PlotFileVarNames();
+        Vector<std::string> vars;
+        if (pp.queryarr("vars", vars)) {
+            for (const auto& var : vars) {
+                const auto it = std::find(all_vars.begin(), all_vars.end(), var);
+                if (it == all_vars.end()) {
+                    amrex::Abort("plot." + name + ".vars: unknown variable " + var);
+                }
+                v.comps.push_back(static_cast<int>(it - all_vars.begin()));
+            }
+        } else {
+            for (int n = 0; n < all_vars.size(); ++n) {
+                v.comps.push_back(n);
+            }
+        }
+
+        if (v.lev_min < 0 || v.lev_min > v.lev_max || v.coarsen < 1) {
+            amrex::Abort("plot." + name + ": need 0 <= lev_min <= lev_max and coarsen >= 1");
+        }
+
+        plot_views.push_back(v);
+    }
+}
+
+// write levels lev_min to lev_max of the view, cut to its region and
+// coarsened by its factor. The levels keep the domain of the full
+// hierarchy, only their BoxArrays are restricted to the region. The cut
+// boxes keep the ranks of the grids they come from, so only the
+// coarsened data is written and nothing moves.
+void
+AmrCoreAdv::WritePlotView (const PlotView& v) const
+{
+    TelemetryTimer tt(telemetry.get(), TelemetryPhase::IO);
+
+    const int lev_max = std::min(v.lev_max, finest_level);
+    const int ncomp = v.comps.size();
+    const IntVect crse(v.coarsen);
+
+    const Vector<std::string>& all_vars = PlotFileVarNames();
+    Vector<std::string> varnames;
+    for (int n : v.comps) {
+        varnames.push_back(all_vars[n]);
+    }
+
+    Vector<MultiFab> mf;
+    Vector<Geometry> vgeom;
+    Vector<int> vstep;
+    Vector<IntVect> vratio;
+
+    Long cells_written = 0;
+    Long cells_total = 0;
+    for (int lev = 0; lev <= finest_level; ++lev) {
+        cells_total += grids[lev].numPts();
+    }
+
+    if (v.lev_min > lev_max) return;
+
+    // the cells of the region on lev_min, aligned to the coarsening factor; the
+    // finer levels use it refined, so the regions of the levels nest
+    Box rbox;
+    {
+        const auto dx = geom[v.lev_min].CellSizeArray();
+        const auto prob_lo = geom[v.lev_min].ProbLoArray();
+        IntVect rlo, rhi;
+        for (int d = 0; d < AMREX_SPACEDIM; ++d) {
+            rlo[d] = static_cast<int>(std::floor((v.region.lo(d) - prob_lo[d]) / dx[d]));
+            rhi[d] = static_cast<int>(std::ceil ((v.region.hi(d) - prob_lo[d]) / dx[d])) - 1;
+        }
+        rbox = Box(rlo, rhi) & geom[v.lev_min].Domain();
+        rbox.coarsen(crse).refine(crse);
+        rbox &= geom[v.lev_min].Domain();
+    }
+
+    for (int lev = v.lev_min; lev <= lev_max; ++lev)
+    {
+        if (lev > v.lev_min) {
+            rbox.refine(refRatio(lev-1));
+        }
+
+        BoxList bl;
+        Vector<int> pmap;
+        for (int i = 0; i < grids[lev].size(); ++i)
+        {
+            const Box& b = grids[lev][i] & rbox;
+            if (b.ok()) {
+                bl.push_back(b);
+                pmap.push_back(dmap[lev][i]);
+            }
+        }
+
+        // a level that does not reach into the region ends the view
+        if (bl.isEmpty()) break;
+
+        BoxArray ba(std::move(bl));
+        DistributionMapping dm(std::move(pmap));
+
+        if (v.coarsen > 1 && !ba.coarsenable(crse)) {
+            amrex::Abort("plot." + v.name + ".coarsen must divide the blocking factor of the levels written");
+        }
+
+        MultiFab sub(ba, dm, ncomp, 0);
+        for (int n = 0; n < ncomp; ++n) {
+            sub.ParallelCopy(phi_new[lev], v.comps[n], n, 1);
+        }
+
+        Box vdomain = geom[lev].Domain();
+        if (v.coarsen > 1) {
+            MultiFab crse_sub(amrex::coarsen(ba, crse), dm, ncomp, 0);
+            amrex::average_down(sub, crse_sub, 0, ncomp, crse);
+            std::swap(sub, crse_sub);
+            vdomain.coarsen(crse);
+        }
+
+        cells_written += sub.boxArray().numPts();
+
+        // the levels keep their (coarsened) domain and physical extent, so the
+        // written boxes sit where they are in the full plotfile
+        Array<int, AMREX_SPACEDIM> is_per{AMREX_D_DECL(0,0,0)};
+        for (int d = 0; d < AMREX_SPACEDIM; ++d) {
+            is_per[d] = geom[lev].isPeriodic(d) ? 1 : 0;
+        }
+
+        mf.push_back(std::move(sub));
+        vgeom.push_back(Geometry(vdomain, &geom[lev].ProbDomain(), static_cast<int>(geom[lev].Coord()), is_per.data()));
+        vstep.push_back(istep[lev]);
+        if (lev < lev_max) {
+            vratio.push_back(refRatio(lev));
+        }
+    }
+
+    const int nlevels = mf.size();
+    if (nlevels == 0) return;
+    vratio.resize(std::max(nlevels-1, 0));
+
+    const std::string& filename = amrex::Concatenate(v.file, istep[0], 5);
+
+    amrex::Print() << "Writing plot view " << v.name << " " << filename << ": levels "
+                   << v.lev_min << " to " << v.lev_min + nlevels - 1 << ", "
+                   << Real(cells_written)*ncomp / (Real(cells_total)*all_vars.size())
+                   << " of the full plotfile" << std::endl;
+
+    amrex::WriteMultiLevelPlotfile(filename, nlevels, amrex::GetVecOfConstPtrs(mf), varnames,
+                                   vgeom, t_new[0], vstep, vratio);
+}
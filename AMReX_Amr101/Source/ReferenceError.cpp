@@ -0,0 +1,70 @@
+#include <cmath>
+
+#include <AMReX_MultiFabUtil.H>
+#include <AMReX_ParallelDescriptor.H>
+#include <AMReX_PlotFileUtil.H>
+
+#include <AmrCoreAdv.H>
+
+using namespace amrex;
+
+// compare level 0 against a reference plotfile (e.g. a uniformly fine run),
+// so the error of a tagging setup can be weighed against the cells it advanced
+void
+AmrCoreAdv::ReportReferenceError () const
+{
+    if (tag_reference.empty()) return;
+
+    PlotFileData pf(tag_reference);
+
+    const Box& domain = geom[0].Domain();
+
+    // the finest reference level that covers the whole domain at an
+    // integer refinement of level 0
+    int rlev = -1;
+    int ratio = 1;
+    for (int lev = pf.finestLevel(); lev >= 0 && rlev < 0; --lev)
+    {
+        const Box& rdomain = pf.probDomain(lev);
+        const int r = rdomain.length(0) / domain.length(0);
+        if (r >= 1 && amrex::coarsen(rdomain, r) == domain && amrex::refine(domain, r) == rdomain
+            && pf.boxArray(lev).numPts() == rdomain.numPts())
+        {
+            rlev = lev;
+            ratio = r;
+        }
+    }
+
+    if (rlev < 0) {
+        amrex::Print() << "Reference " << tag_reference
+                       << " has no level covering the domain at a refinement of level 0" << std::endl;
+        return;
+    }
+
+    MultiFab ref = pf.get(rlev, "phi");
+
+    MultiFab crse;
+    if (ratio > 1) {
+        crse.define(amrex::coarsen(ref.boxArray(), ratio), ref.DistributionMap(), 1, 0);
+        amrex::average_down(ref, crse, 0, 1, IntVect(ratio));
+    }
+    const MultiFab& refc = (ratio > 1) ? crse : ref;
+
+    MultiFab err(grids[0], dmap[0], 1, 0);
+    err.ParallelCopy(refc, 0, 0, 1);
+    MultiFab::Subtract(err, phi_new[0], 0, 0, 1, 0);
+
+    const Real ncells = domain.d_numPts();
+    const Real l1   = err.norm1(0) / ncells;
+    const Real l2   = err.norm2(0) / std::sqrt(ncells);
+    const Real linf = err.norm0(0);
+
+    Long cost = 0;
+    for (int lev = 0; lev <= max_level; ++lev) {
+        cost += advance_cells[lev];
+    }
+
+    amrex::Print() << "\nError against " << tag_reference << " (level " << rlev << ")\n"
+                   << "  L1 " << l1 << ", L2 " << l2 << ", Linf " << linf
+                   << ", cells advanced " << cost << "\n";
+}
@@ -0,0 +1,65 @@
+#include <AMReX_ParallelDescriptor.H>
+
+#include <AmrCoreAdv.H>
+
+using namespace amrex;
+
+// the phi threshold above which a fraction frac of the domain lies,
+// from a histogram of the level 0 data (which covers the whole domain
+// with equal cells, and holds the average of the finer levels)
+Real
+AmrCoreAdv::RefineThreshold (Real frac) const
+{
+    constexpr int nbins = 1024;
+
+    const MultiFab& state = phi_new[0];
+    const Real phimin = state.min(0);
+    const Real phimax = state.max(0);
+
+    if (phimax <= phimin) return phimax;
+
+    const Real binv = nbins / (phimax - phimin);
+
+    Gpu::DeviceVector<int> dhist(nbins, 0);
+    int* hist = dhist.data();
+
+    for (MFIter mfi(state); mfi.isValid(); ++mfi)
+    {
+        const Box& bx = mfi.validbox();
+        const auto phi = state.const_array(mfi);
+
+        amrex::ParallelFor(bx,
+        [=] AMREX_GPU_DEVICE (int i, int j, int k) noexcept
+        {
+            int b = static_cast<int>((phi(i,j,k) - phimin)*binv);
+            b = amrex::min(amrex::max(b, 0), nbins-1);
+            Gpu::Atomic::Add(hist+b, 1);
+        });
+    }
+
+    Vector<int> ihist(nbins);
+    Gpu::copy(Gpu::deviceToHost, dhist.begin(), dhist.end(), ihist.begin());
+
+    Vector<Long> lhist(ihist.begin(), ihist.end());
+    ParallelDescriptor::ReduceLongSum(lhist.data(), nbins);
+
+    const Long ncells = geom[0].Domain().numPts();
+    const Long target = static_cast<Long>(frac*ncells);
+
+    // walk down from the largest values until enough cells are above
+    Long above = 0;
+    int b = nbins-1;
+    for (; b > 0; --b) {
+        above += lhist[b];
+        if (above >= target) break;
+    }
+
+    const Real thresh = phimin + b/binv;
+
+    if (Verbose()) {
+        amrex::Print() << "Refine fraction " << frac << ": threshold " << thresh
+                       << " covers " << Real(above)/ncells << " of the domain" << std::endl;
+    }
+
+    return thresh;
+}
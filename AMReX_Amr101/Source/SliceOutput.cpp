@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+
+#include <AMReX_ParallelDescriptor.H>
+#include <AMReX_Utility.H>
+
+#include <AmrCoreAdv.H>
+
+using namespace amrex;
+
+namespace {
+
+// ---------------------------------------------------------------------
+// minimal PNG writer: 8 bit RGB, deflate "stored" blocks, so no zlib
+// ---------------------------------------------------------------------
+
+std::uint32_t
+crc32 (const unsigned char* buf, std::size_t len, std::uint32_t crc = 0)
+{
+    static std::uint32_t table[256];
+    static bool init = false;
+    if (!init) {
+        for (std::uint32_t n = 0; n < 256; ++n) {
+            std::uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        init = true;
+    }
+
+    crc = ~crc;
+    for (std::size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void
+put_u32 (std::vector<unsigned char>& out, std::uint32_t v)
+{
+    out.push_back((v >> 24) & 0xff);
+    out.push_back((v >> 16) & 0xff);
+    out.push_back((v >>  8) & 0xff);
+    out.push_back( v        & 0xff);
+}
+
+void
+write_chunk (std::ofstream& ofs, const char* type, const std::vector<unsigned char>& data)
+{
+    std::vector<unsigned char> chunk(type, type+4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+
+    std::vector<unsigned char> len;
+    put_u32(len, data.size());
+    std::vector<unsigned char> crc;
+    put_u32(crc, crc32(chunk.data(), chunk.size()));
+
+    ofs.write(reinterpret_cast<const char*>(len.data()), 4);
+    ofs.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    ofs.write(reinterpret_cast<const char*>(crc.data()), 4);
+}
+
+// rgb holds nx*ny pixels, rows top to bottom
+void
+write_png (const std::string& filename, int nx, int ny, const std::vector<unsigned char>& rgb)
+{
+    std::ofstream ofs(filename.c_str(), std::ios::binary | std::ios::trunc);
+    if (!ofs.good()) {
+        amrex::FileOpenFailed(filename);
+    }
+
+    const unsigned char sig[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    ofs.write(reinterpret_cast<const char*>(sig), 8);
+
+    std::vector<unsigned char> ihdr;
+    put_u32(ihdr, nx);
+    put_u32(ihdr, ny);
+    ihdr.push_back(8);  // bit depth
+    ihdr.push_back(2);  // RGB
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    write_chunk(ofs, "IHDR", ihdr);
+
+    // scanlines with filter type 0
+    std::vector<unsigned char> raw;
+    raw.reserve(ny*(3*nx+1));
+    for (int j = 0; j < ny; ++j) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + 3*nx*j, rgb.begin() + 3*nx*(j+1));
+    }
+
+    // zlib stream of stored blocks
+    std::vector<unsigned char> z = {0x78, 0x01};
+    std::uint32_t a = 1, b = 0;
+    for (unsigned char c : raw) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    std::size_t pos = 0;
+    do {
+        const std::size_t n = std::min<std::size_t>(65535, raw.size() - pos);
+        const bool last = pos + n == raw.size();
+        z.push_back(last ? 1 : 0);
+        z.push_back(n & 0xff);
+        z.push_back((n >> 8) & 0xff);
+        z.push_back(~n & 0xff);
+        z.push_back((~n >> 8) & 0xff);
+        z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + n);
+        pos += n;
+    } while (pos < raw.size());
+    put_u32(z, (b << 16) | a);
+
+    write_chunk(ofs, "IDAT", z);
+    write_chunk(ofs, "IEND", {});
+}
+
+// blue - cyan - green - yellow - red
+void
+colormap (Real f, unsigned char* rgb)
+{
+    static const Real cmap[5][3] = {{0,0,1}, {0,1,1}, {0,1,0}, {1,1,0}, {1,0,0}};
+    f = amrex::min(amrex::max(f, Real(0.0)), Real(1.0)) * 4.0;
+    const int i = amrex::min(static_cast<int>(f), 3);
+    const Real w = f - i;
+    for (int c = 0; c < 3; ++c) {
+        rgb[c] = static_cast<unsigned char>(255.0*((1.0-w)*cmap[i][c] + w*cmap[i+1][c]) + 0.5);
+    }
+}
+
+}
+
+// Resample the composite hierarchy on each axis-aligned slice to a fixed
+// grid of pixels, taking every pixel from the finest level that covers
+// it, and write the frame as raw float32 values and as a PNG image.
+// Only the pixels travel to the I/O rank, so a frame costs a few hundred
+// KB instead of a full plotfile.
+void
+AmrCoreAdv::WriteSlices () const
+{
+    TelemetryTimer tt(telemetry.get(), TelemetryPhase::IO);
+
+    const int nu = slice_npix[0];
+    const int nv = slice_npix[1];
+    const int npix = nu*nv;
+
+    for (int s = 0; s < slice_dir.size(); ++s)
+    {
+        const int dir = slice_dir[s];
+        amrex::ignore_unused(dir);
+
+        // in-plane directions; in 2D the only slice is the plane itself
+#if (AMREX_SPACEDIM == 2)
+        const int du = 0;
+        const int dv = 1;
+#else
+        const int du = (dir == 0) ? 1 : 0;
+        const int dv = (dir == 2) ? 1 : 2;
+#endif
+        const auto prob_lo = geom[0].ProbLoArray();
+        const auto prob_hi = geom[0].ProbHiArray();
+        const Real pu = (prob_hi[du] - prob_lo[du]) / nu;
+        const Real pv = (prob_hi[dv] - prob_lo[dv]) / nv;
+
+        // the middle of the domain unless given
+#if (AMREX_SPACEDIM > 2)
+        const Real pos = (s < slice_pos.size()) ? slice_pos[s]
+                                                : 0.5*(prob_lo[dir] + prob_hi[dir]);
+#endif
+
+        Gpu::DeviceVector<Real> dimg(npix, 0.0);
+        Gpu::DeviceVector<int> dlev(npix, -1);
+        Real* img = dimg.data();
+        int* plev = dlev.data();
+
+        for (int lev = 0; lev <= finest_level; ++lev)
+        {
+            const auto dx = geom[lev].CellSizeArray();
+
+            // the cells along the normal that contain the slice
+            int islice = 0;
+#if (AMREX_SPACEDIM > 2)
+            const Box& domain = geom[lev].Domain();
+            islice = static_cast<int>(std::floor((pos - prob_lo[dir]) / dx[dir]));
+            islice = amrex::min(amrex::max(islice, domain.smallEnd(dir)), domain.bigEnd(dir));
+#endif
+
+            for (MFIter mfi(phi_new[lev]); mfi.isValid(); ++mfi)
+            {
+                const Box& bx = mfi.validbox();
+#if (AMREX_SPACEDIM > 2)
+                if (islice < bx.smallEnd(dir) || islice > bx.bigEnd(dir)) continue;
+#endif
+                // pixels whose centers lie in the box
+                const int iulo = amrex::max(0,    static_cast<int>(std::ceil (bx.smallEnd(du)*dx[du]/pu - 0.5)));
+                const int iuhi = amrex::min(nu-1, static_cast<int>(std::ceil((bx.bigEnd(du)+1)*dx[du]/pu - 0.5)) - 1);
+                const int ivlo = amrex::max(0,    static_cast<int>(std::ceil (bx.smallEnd(dv)*dx[dv]/pv - 0.5)));
+                const int ivhi = amrex::min(nv-1, static_cast<int>(std::ceil((bx.bigEnd(dv)+1)*dx[dv]/pv - 0.5)) - 1);
+                if (iulo > iuhi || ivlo > ivhi) continue;
+
+                const Box pixbox(IntVect(AMREX_D_DECL(iulo, ivlo, 0)), IntVect(AMREX_D_DECL(iuhi, ivhi, 0)));
+                const auto state = phi_new[lev].const_array(mfi);
+                const auto blo = amrex::lbound(bx);
+                const auto bhi = amrex::ubound(bx);
+
+                amrex::ParallelFor(pixbox,
+                [=] AMREX_GPU_DEVICE (int iu, int iv, int) noexcept
+                {
+                    IntVect iv_cell(AMREX_D_DECL(0,0,0));
+                    iv_cell[du] = static_cast<int>(std::floor((iu+0.5)*pu/dx[du]));
+                    iv_cell[dv] = static_cast<int>(std::floor((iv+0.5)*pv/dx[dv]));
+#if (AMREX_SPACEDIM > 2)
+                    iv_cell[dir] = islice;
+#endif
+                    // guard against round-off at the box edges
+                    iv_cell[0] = amrex::min(amrex::max(iv_cell[0], blo.x), bhi.x);
+                    iv_cell[1] = amrex::min(amrex::max(iv_cell[1], blo.y), bhi.y);
+#if (AMREX_SPACEDIM > 2)
+                    iv_cell[2] = amrex::min(amrex::max(iv_cell[2], blo.z), bhi.z);
+#endif
+                    const int p = iu + nu*iv;
+                    img[p] = state(iv_cell);
+                    plev[p] = lev;
+                });
+            }
+        }
+
+        Vector<Real> himg(npix);
+        Vector<int> hlev(npix);
+        Gpu::copy(Gpu::deviceToHost, dimg.begin(), dimg.end(), himg.begin());
+        Gpu::copy(Gpu::deviceToHost, dlev.begin(), dlev.end(), hlev.begin());
+
+        // every pixel comes from the rank holding its finest covering level
+        Vector<int> flev(hlev);
+        ParallelDescriptor::ReduceIntMax(flev.data(), npix);
+        for (int p = 0; p < npix; ++p) {
+            if (hlev[p] != flev[p]) himg[p] = 0.0;
+        }
+        ParallelDescriptor::ReduceRealSum(himg.data(), npix, ParallelDescriptor::IOProcessorNumber());
+
+        if (!ParallelDescriptor::IOProcessor()) continue;
+
+        const std::string name = amrex::Concatenate(slice_file + "_" + std::to_string(s) + "_", istep[0], 5);
+
+        {
+            std::ofstream ofs((name + ".raw").c_str(), std::ios::binary | std::ios::trunc);
+            if (!ofs.good()) {
+                amrex::FileOpenFailed(name + ".raw");
+            }
+            std::vector<float> f(himg.begin(), himg.end());
+            ofs.write(reinterpret_cast<const char*>(f.data()), f.size()*sizeof(float));
+        }
+
+        Real vmin, vmax;
+        if (slice_range.size() == 2) {
+            vmin = slice_range[0];
+            vmax = slice_range[1];
+        } else {
+            vmin = *std::min_element(himg.begin(), himg.end());
+            vmax = *std::max_element(himg.begin(), himg.end());
+        }
+        const Real scale = (vmax > vmin) ? 1.0/(vmax - vmin) : 0.0;
+
+        // PNG rows go top to bottom
+        std::vector<unsigned char> rgb(3*npix);
+        for (int iv = 0; iv < nv; ++iv) {
+            for (int iu = 0; iu < nu; ++iu) {
+                colormap((himg[iu + nu*iv] - vmin)*scale, &rgb[3*(iu + nu*(nv-1-iv))]);
+            }
+        }
+        write_png(name + ".png", nu, nv, rgb);
+    }
+}
@@ -0,0 +1,222 @@
+#include <iomanip>
+
+#include <AMReX_BaseFab.H>
+#include <AMReX_ParallelDescriptor.H>
+#include <AMReX_Print.H>
+#include <AMReX_Utility.H>
+
+#include <Telemetry.H>
+
+using namespace amrex;
+
+namespace {
+constexpr int nphases = static_cast<int>(TelemetryPhase::NumPhases);
+}
+
+Telemetry::Telemetry (const std::string& filename, int nlevs, int ncomp)
+    : m_nlevs(nlevs),
+      m_ncomp(ncomp),
+      m_step_time(nphases*(nlevs+1), 0.0),
+      m_total_time(nphases*(nlevs+1), 0.0),
+      m_fillpatch_bytes(nlevs, 0),
+      m_avgdown_bytes(nlevs, 0),
+      m_step_comm(nlevs, 0),
+      m_total_comm(nlevs, 0),
+      m_last_cells(nlevs, 0),
+      m_total_cells(nlevs, 0)
+{
+    if (ParallelDescriptor::IOProcessor()) {
+        m_ofs.open(filename.c_str(), std::ios::out | std::ios::trunc);
+        if (!m_ofs.good()) {
+            amrex::FileOpenFailed(filename);
+        }
+        m_ofs << std::setprecision(6);
+    }
+}
+
+const char*
+Telemetry::PhaseName (TelemetryPhase phase)
+{
+    switch (phase)
+    {
+    case TelemetryPhase::Advect:      return "advect";
+    case TelemetryPhase::FillPatch:   return "fillpatch";
+    case TelemetryPhase::Reflux:      return "reflux";
+    case TelemetryPhase::AverageDown: return "average_down";
+    case TelemetryPhase::Regrid:      return "regrid";
+    case TelemetryPhase::ErrorEst:    return "error_est";
+    case TelemetryPhase::ComputeDt:   return "compute_dt";
+    case TelemetryPhase::IO:          return "io";
+    default:                          return "unknown";
+    }
+}
+
+void
+Telemetry::Start (TelemetryPhase phase, int lev)
+{
+    m_stack.push_back(Frame{phase, lev, static_cast<Real>(amrex::second()), Real(0.0)});
+}
+
+void
+Telemetry::Stop ()
+{
+    AMREX_ASSERT(!m_stack.empty());
+
+    const Frame f = m_stack.back();
+    m_stack.pop_back();
+
+    const Real elapsed = amrex::second() - f.start;
+    m_step_time[idx(f.phase, f.lev)] += elapsed - f.child;
+
+    if (!m_stack.empty()) {
+        m_stack.back().child += elapsed;
+    }
+}
+
+void
+Telemetry::SetCommEstimate (const Vector<Long>& fillpatch_bytes,
+                            const Vector<Long>& avgdown_bytes)
+{
+    for (int lev = 0; lev < m_nlevs; ++lev) {
+        m_fillpatch_bytes[lev] = (lev < fillpatch_bytes.size()) ? fillpatch_bytes[lev] : 0;
+        m_avgdown_bytes[lev]   = (lev < avgdown_bytes.size())   ? avgdown_bytes[lev]   : 0;
+    }
+}
+
+void
+Telemetry::AddFillPatch (int lev)
+{
+    m_step_comm[lev] += m_fillpatch_bytes[lev];
+}
+
+void
+Telemetry::AddAverageDown (int lev)
+{
+    m_step_comm[lev] += m_avgdown_bytes[lev];
+}
+
+void
+Telemetry::EndStep (int step, Real time, Real dt, int finest_level, const Vector<Long>& cells)
+{
+    ++m_nsteps;
+
+    const int nt = m_step_time.size();
+
+    // one reduction for the times and one for the counters
+    Vector<Real> tmax(m_step_time);
+    ParallelDescriptor::ReduceRealMax(tmax.data(), nt);
+
+    // the cell counts are global already; only the comm bytes and memory are per rank
+    Vector<Long> counts(m_step_comm);
+    counts.push_back(amrex::TotalBytesAllocatedInFabs());
+    ParallelDescriptor::ReduceLongSum(counts.data(), counts.size());
+
+    if (ParallelDescriptor::IOProcessor())
+    {
+        const Long state_bytes = 2*m_ncomp*sizeof(Real);
+
+        m_ofs << "{\"step\":" << step << ",\"time\":" << time << ",\"dt\":" << dt
+              << ",\"bytes_allocated\":" << counts[m_nlevs] << ",\"levels\":[";
+        for (int lev = 0; lev <= finest_level; ++lev)
+        {
+            const Long ncells = cells[lev] - m_last_cells[lev];
+            const Real tadv = tmax[idx(TelemetryPhase::Advect, lev)];
+            if (lev > 0) m_ofs << ",";
+            m_ofs << "{\"level\":" << lev << ",\"cells\":" << ncells
+                  << ",\"mpi_bytes\":" << counts[lev];
+            for (int p = 0; p < nphases; ++p) {
+                const auto phase = static_cast<TelemetryPhase>(p);
+                m_ofs << ",\"" << PhaseName(phase) << "\":" << tmax[idx(phase,lev)];
+            }
+            // the state is read and written once per cell advanced
+            m_ofs << ",\"cells_per_s\":" << (tadv > 0.0 ? ncells/tadv : 0.0)
+                  << ",\"gb_per_s\":" << (tadv > 0.0 ? ncells*state_bytes/tadv*1.e-9 : 0.0)
+                  << "}";
+        }
+        m_ofs << "],\"global\":{";
+        for (int p = 0; p < nphases; ++p) {
+            const auto phase = static_cast<TelemetryPhase>(p);
+            if (p > 0) m_ofs << ",";
+            m_ofs << "\"" << PhaseName(phase) << "\":" << tmax[idx(phase,-1)];
+        }
+        m_ofs << "}}\n";
+        m_ofs.flush();
+    }
+
+    for (int i = 0; i < nt; ++i) {
+        m_total_time[i] += m_step_time[i];
+        m_step_time[i] = 0.0;
+    }
+    for (int lev = 0; lev < m_nlevs; ++lev) {
+        m_total_cells[lev] += cells[lev] - m_last_cells[lev];
+        m_last_cells[lev] = cells[lev];
+        m_total_comm[lev] += m_step_comm[lev];
+        m_step_comm[lev] = 0;
+    }
+}
+
+void
+Telemetry::Finalize ()
+{
+    const int nt = m_total_time.size();
+    const int nprocs = ParallelDescriptor::NProcs();
+
+    Vector<Real> tmin(m_total_time);
+    Vector<Real> tmax(m_total_time);
+    Vector<Real> tavg(m_total_time);
+    ParallelDescriptor::ReduceRealMin(tmin.data(), nt);
+    ParallelDescriptor::ReduceRealMax(tmax.data(), nt);
+    ParallelDescriptor::ReduceRealSum(tavg.data(), nt);
+    for (auto& t : tavg) t /= nprocs;
+
+    // the cell counts are global already
+    Vector<Long> comm(m_total_comm);
+    ParallelDescriptor::ReduceLongSum(comm.data(), comm.size());
+
+    if (!ParallelDescriptor::IOProcessor()) return;
+
+    m_ofs << "{\"summary\":{\"steps\":" << m_nsteps << ",\"ranks\":" << nprocs << ",\"levels\":[";
+    for (int lev = 0; lev <= m_nlevs; ++lev)
+    {
+        const int l = (lev < m_nlevs) ? lev : -1;
+        if (lev > 0) m_ofs << ",";
+        if (l >= 0) {
+            m_ofs << "{\"level\":" << l << ",\"cells\":" << m_total_cells[l]
+                  << ",\"mpi_bytes\":" << comm[l];
+        } else {
+            m_ofs << "{\"level\":\"global\"";
+        }
+        for (int p = 0; p < nphases; ++p) {
+            const int i = idx(static_cast<TelemetryPhase>(p), l);
+            m_ofs << ",\"" << PhaseName(static_cast<TelemetryPhase>(p)) << "\":["
+                  << tmin[i] << "," << tavg[i] << "," << tmax[i] << "]";
+        }
+        m_ofs << "}";
+    }
+    m_ofs << "]}}\n";
+    m_ofs.flush();
+
+    amrex::Print() << "\nTelemetry summary (seconds, min / avg / max over ranks)\n";
+    for (int lev = 0; lev <= m_nlevs; ++lev)
+    {
+        const int l = (lev < m_nlevs) ? lev : -1;
+        bool any = false;
+        for (int p = 0; p < nphases; ++p) {
+            any = any || tmax[idx(static_cast<TelemetryPhase>(p), l)] > 0.0;
+        }
+        if (!any) continue;
+
+        if (l >= 0) {
+            amrex::Print() << "  Level " << l << ": " << counts[l] << " cells, "
+                           << counts[m_nlevs+l] << " MPI bytes (est.)\n";
+        } else {
+            amrex::Print() << "  Global:\n";
+        }
+        for (int p = 0; p < nphases; ++p) {
+            const int i = idx(static_cast<TelemetryPhase>(p), l);
+            if (tmax[i] == 0.0) continue;
+            amrex::Print() << "    " << std::setw(12) << std::left << PhaseName(static_cast<TelemetryPhase>(p))
+                           << tmin[i] << " / " << tavg[i] << " / " << tmax[i] << "\n";
+        }
+    }
+}
@@ -0,0 +1,226 @@
+#include <cmath>
+#include <iomanip>
+
+#include <AMReX_MultiFab.H>
+#include <AMReX_ParallelDescriptor.H>
+#include <AMReX_Reduce.H>
+
+#include <FluidParticleContainer.H>
+
+using namespace amrex;
+
+namespace {
+
+// seconds per deposit, max over ranks
+Real
+time_deposit (FluidParticleContainer& pc, MultiFab& phi, int interpolation, int deposit, int nrep)
+{
+    pc.DepositToMesh(phi, interpolation, deposit);   // warm up
+
+    ParallelDescriptor::Barrier();
+    const Real strt = amrex::second();
+    for (int n = 0; n < nrep; ++n) {
+        pc.DepositToMesh(phi, interpolation, deposit);
+    }
+    Real t = (amrex::second() - strt) / nrep;
+    ParallelDescriptor::ReduceRealMax(t);
+    return t;
+}
+
+// rms of dep - phi, relative to the max of phi, over the uncovered cells where phi > phi_cutoff
+Real
+deposit_error (const MultiFab& dep, const MultiFab& phi, const MultiFab& ebvol, Real phi_cutoff)
+{
+    ReduceOps<ReduceOpSum, ReduceOpSum> reduce_op;
+    ReduceData<Real, Real> reduce_data(reduce_op);
+    using ReduceTuple = typename decltype(reduce_data)::Type;
+
+    for (MFIter mfi(dep); mfi.isValid(); ++mfi)
+    {
+        const Box& bx = mfi.validbox();
+        const auto d = dep.const_array(mfi);
+        const auto ref = phi.const_array(mfi);
+        const auto vol = ebvol.const_array(mfi);
+        reduce_op.eval(bx, reduce_data,
+        [=] AMREX_GPU_DEVICE (int i, int j, int k) -> ReduceTuple
+        {
+            if (vol(i,j,k) < 1.0 || ref(i,j,k) <= phi_cutoff) return {0.0, 0.0};
+            const Real e = d(i,j,k) - ref(i,j,k);
+            return {e*e, 1.0};
+        });
+    }
+
+    ReduceTuple hv = reduce_data.value();
+    Real sums[2] = {amrex::get<0>(hv), amrex::get<1>(hv)};
+    ParallelDescriptor::ReduceRealSum(sums, 2);
+
+    const Real phi_max = phi.norm0(0, 0);
+    return (sums[1] > 0.0 && phi_max > 0.0) ? std::sqrt(sums[0]/sums[1]) / phi_max : 0.0;
+}
+
+}
+
+//
+// Time the atomic and the tile-private deposition for each number of particles
+// per cell in ppc, from particles initialized like the run's, and check that
+// both give the same phi and that the tile-private one is reproducible.
+//
+void
+benchmark_deposit (const Geometry& geom, const DistributionMapping& dmap, const BoxArray& grids,
+                   const MultiFab& phi, const MultiFab& ebvol, Real phi_cutoff,
+                   const Vector<int>& ppc, int interpolation, int nrep)
+{
+    amrex::Print() << "\nDeposition benchmark (" << nrep << " deposits each, ns per particle)\n"
+                   << "  n_ppc   particles      atomic  tile-private  speedup  max|diff|  reproducible\n";
+
+    for (int nppc : ppc)
+    {
+        FluidParticleContainer pc(geom, dmap, grids);
+        pc.InitParticles(phi, ebvol, phi_cutoff, nppc, interpolation);
+        const Long np = pc.TotalNumberOfParticles();
+
+        MultiFab phi_atomic(grids, dmap, 1, phi.nGrow());
+        MultiFab phi_private(grids, dmap, 1, phi.nGrow());
+        MultiFab phi_again(grids, dmap, 1, phi.nGrow());
+
+        const Real t_atomic  = time_deposit(pc, phi_atomic,  interpolation, Deposit::Atomic,      nrep);
+        const Real t_private = time_deposit(pc, phi_private, interpolation, Deposit::TilePrivate, nrep);
+        pc.DepositToMesh(phi_again, interpolation, Deposit::TilePrivate);
+
+        // valid cells only; the ghost cells hold what was summed to the neighbors
+        MultiFab::Subtract(phi_atomic, phi_private, 0, 0, 1, 0);
+        MultiFab::Subtract(phi_again, phi_private, 0, 0, 1, 0);
+        const Real diff = phi_atomic.norm0(0, 0);
+        const bool reproducible = phi_again.norm0(0, 0) == 0.0;
+
+        const Real ns = (np > 0) ? 1.e9 / np : 0.0;
+        amrex::Print() << "  " << std::setw(5) << nppc << "  " << std::setw(10) << np
+                       << "  " << std::setw(10) << t_atomic*ns
+                       << "  " << std::setw(12) << t_private*ns
+                       << "  " << std::setw(7) << (t_private > 0.0 ? t_atomic/t_private : 0.0)
+                       << "  " << std::setw(9) << diff
+                       << "  " << (reproducible ? "yes" : "no") << "\n";
+    }
+    amrex::Print() << std::endl;
+}
+
+//
+// Noise versus cost of the particle shapes: for each shape and each number of
+// particles per cell, initialize the particles from phi, deposit them back and
+// compare with phi in the uncovered cells where phi > phi_cutoff. The rms error
+// (relative to the max of phi) falls with n_ppc, and faster for smoother shapes,
+// so the table shows the cheapest shape and n_ppc that reach a given noise level.
+// phi needs the ghost cells of the widest shape.
+//
+void
+benchmark_shapes (const Geometry& geom, const DistributionMapping& dmap, const BoxArray& grids,
+                  const MultiFab& phi, const MultiFab& ebvol, Real phi_cutoff,
+                  const Vector<int>& ppc, int deposit, int nrep)
+{
+    static const char* names[] = {"NGP", "CIC", "TSC", "QSP"};
+    const int shapes[] = {Interpolation::NGP, Interpolation::CIC, Interpolation::TSC, Interpolation::QSP};
+
+    amrex::Print() << "\nShape benchmark (" << nrep << " deposits each)\n"
+                   << "  shape  n_ppc   particles   rms error  ms/deposit  ns/particle\n";
+
+    for (int shape : shapes)
+    {
+        for (int nppc : ppc)
+        {
+            FluidParticleContainer pc(geom, dmap, grids);
+            pc.InitParticles(phi, ebvol, phi_cutoff, nppc, shape);
+            const Long np = pc.TotalNumberOfParticles();
+
+            MultiFab dep(grids, dmap, 1, phi.nGrow());
+            const Real t = time_deposit(pc, dep, shape, deposit, nrep);
+
+            const Real rms = deposit_error(dep, phi, ebvol, phi_cutoff);
+
+            amrex::Print() << "  " << std::setw(5) << names[shape] << "  " << std::setw(5) << nppc
+                           << "  " << std::setw(10) << np
+                           << "  " << std::setw(10) << rms
+                           << "  " << std::setw(10) << t*1.e3
+                           << "  " << std::setw(11) << (np > 0 ? t*1.e9/np : 0.0) << "\n";
+        }
+    }
+    amrex::Print() << std::endl;
+}
+
+//
+// Particles per cell needed by each seeding for a target noise: for each seeding
+// and each n_ppc, initialize the particles from phi, deposit them back and take
+// the rms error against phi as above. The target is the error of the random
+// seeding at the largest n_ppc unless given; for each seeding the smallest n_ppc
+// that reaches it is reported with its deposit time, the particle-mesh part of
+// a step, which scales with the number of particles like the rest of the step.
+//
+void
+benchmark_seeding (const Geometry& geom, const DistributionMapping& dmap, const BoxArray& grids,
+                   const MultiFab& phi, const MultiFab& ebvol, Real phi_cutoff,
+                   const Vector<int>& ppc, int interpolation, int deposit, int nrep, Real target)
+{
+    static const char* names[] = {"random", "halton", "jitter"};
+    const int seedings[] = {Seeding::Random, Seeding::Halton, Seeding::Jittered};
+    constexpr int nseedings = 3;
+
+    const int nppc_list = ppc.size();
+    Vector<Real> err(nseedings*nppc_list);
+    Vector<Real> time(nseedings*nppc_list);
+
+    amrex::Print() << "\nSeeding benchmark (" << nrep << " deposits each)\n"
+                   << "  seeding  n_ppc   particles   rms error  ms/deposit\n";
+
+    for (int s : seedings)
+    {
+        for (int n = 0; n < nppc_list; ++n)
+        {
+            FluidParticleContainer pc(geom, dmap, grids);
+            pc.InitParticles(phi, ebvol, phi_cutoff, ppc[n], interpolation, s);
+            const Long np = pc.TotalNumberOfParticles();
+
+            MultiFab dep(grids, dmap, 1, phi.nGrow());
+            time[s*nppc_list + n] = time_deposit(pc, dep, interpolation, deposit, nrep);
+            err[s*nppc_list + n] = deposit_error(dep, phi, ebvol, phi_cutoff);
+
+            amrex::Print() << "  " << std::setw(7) << names[s] << "  " << std::setw(5) << ppc[n]
+                           << "  " << std::setw(10) << np
+                           << "  " << std::setw(10) << err[s*nppc_list + n]
+                           << "  " << std::setw(10) << time[s*nppc_list + n]*1.e3 << "\n";
+        }
+    }
+
+    if (target <= 0.0 && nppc_list > 0) {
+        int nmax = 0;
+        for (int n = 1; n < nppc_list; ++n) {
+            if (ppc[n] > ppc[nmax]) nmax = n;
+        }
+        target = err[Seeding::Random*nppc_list + nmax];
+    }
+
+    amrex::Print() << "\n  For an rms error of " << target << ":\n";
+
+    Real t_random = 0.0;
+    for (int s : seedings)
+    {
+        // the smallest n_ppc that reaches the target
+        int best = -1;
+        for (int n = 0; n < nppc_list; ++n) {
+            if (err[s*nppc_list + n] <= target && (best < 0 || ppc[n] < ppc[best])) best = n;
+        }
+
+        if (best < 0) {
+            amrex::Print() << "  " << std::setw(7) << names[s] << "  not reached with the n_ppc given\n";
+            continue;
+        }
+
+        const Real t = time[s*nppc_list + best];
+        if (s == Seeding::Random) t_random = t;
+        amrex::Print() << "  " << std::setw(7) << names[s] << "  n_ppc = " << std::setw(4) << ppc[best]
+                       << "  " << t*1.e3 << " ms/deposit";
+        if (s != Seeding::Random && t_random > 0.0 && t > 0.0) {
+            amrex::Print() << ", " << t_random/t << "x faster than random";
+        }
+        amrex::Print() << "\n";
+    }
+    amrex::Print() << std::endl;
+}
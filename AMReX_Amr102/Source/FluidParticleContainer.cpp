@@ -1,28 +1,161 @@
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <queue>
+
+#include <AMReX_Random.H>
+#include <AMReX_Scan.H>
 
 #include <FluidParticleContainer.H>
 
 namespace amrex {
 
+namespace {
+
+// the n-th element of the van der Corput sequence in base b
+AMREX_GPU_HOST_DEVICE AMREX_FORCE_INLINE
+Real radical_inverse (int n, int b)
+{
+    Real x = 0.0;
+    Real f = 1.0 / b;
+    for (; n > 0; n /= b, f /= b) {
+        x += f * (n % b);
+    }
+    return x;
+}
+
+}
+
 //
-// Initialize a random number of particles per cell determined by nppc
+// Initialize nppc particles, placed as the seeding says (one at the center if
+// nppc == 1), in each cell that can hold live particles. A cell is live if it is not covered by
+// the embedded geometry and phi reaches density_cutoff somewhere in the stencil of
+// the shape around it, since a particle's interpolated phi cannot exceed that.
+// The live cells of each tile are counted and prefix-summed first, so only their
+// particles are allocated, and filled in one pass. RemoveCoveredParticles then
+// only has to drop the few particles of live cells whose phi falls below the cutoff.
 //
 void
-FluidParticleContainer::InitParticles(const MultiFab& phi, const MultiFab& ebvol, Real density_cutoff, int nppc, int interpolation)
+FluidParticleContainer::InitParticles(const MultiFab& phi, const MultiFab& ebvol, Real density_cutoff, int nppc,
+                                      int interpolation, int seeding)
 {
+    BL_PROFILE("FluidParticleContainer::InitParticles()");
+
     // Save the number of particles per cell we are using for the particle-mesh operations
     m_number_particles_per_cell = nppc;
 
-    // Construct a ParticleInitData containing only zeros for the particle buffers and weights
-    amrex::ParticleInitType<PIdx::NStructReal, 0, 0, 0> pdata {};
-
-    if (nppc > 1) {
-        // Create nppc random particles per cell, initialized with zero real struct data
-        InitNRandomPerCell(nppc, pdata);
-    } else if (nppc == 1) {
-        // Or ... create just one particle per cell centered in the cell
-        InitOnePerCell(0.5, 0.5, 0.5, pdata);
-    } else {
+    if (nppc < 1) {
         Print() << "No particles initialized.\n";
+        return;
+    }
+
+    const int lev = 0;
+    AMREX_ALWAYS_ASSERT(OnSameGrids(lev, phi) && OnSameGrids(lev, ebvol));
+
+    const int h = shape_halfwidth(interpolation);
+    AMREX_ALWAYS_ASSERT(phi.nGrow() >= h);
+
+    const auto geom = Geom(lev);
+    const auto plo = geom.ProbLoArray();
+    const auto dx  = geom.CellSizeArray();
+    const int cpu = ParallelDescriptor::MyProc();
+
+    // sub-cells per direction of the jittered seeding
+    int nsub = 1;
+    while (AMREX_D_TERM((nsub+1), *(nsub+1), *(nsub+1)) <= nppc) ++nsub;
+    const int nstrata = AMREX_D_TERM(nsub, *nsub, *nsub);
+
+    for (MFIter mfi = MakeMFIter(lev); mfi.isValid(); ++mfi)
+    {
+        const Box& tile_box = mfi.tilebox();
+        const int ncells = tile_box.numPts();
+        const auto lo = amrex::lbound(tile_box);
+        const auto len = amrex::length(tile_box);
+
+        amrex::Array4<const amrex::Real> const& phi_arr = phi.const_array(mfi);
+        amrex::Array4<const amrex::Real> const& vol_arr = ebvol.const_array(mfi);
+
+        // the particles of each cell: nppc if the cell is live, 0 otherwise
+        Gpu::DeviceVector<int> counts(ncells);
+        Gpu::DeviceVector<int> offsets(ncells);
+        int* pcount = counts.data();
+        int* poffset = offsets.data();
+
+        amrex::ParallelFor(tile_box,
+        [=] AMREX_GPU_DEVICE (int i, int j, int k)
+        {
+            const int c = (i-lo.x) + len.x*((j-lo.y) + len.y*(k-lo.z));
+
+            Real phi_max = phi_arr(i,j,k);
+            for (int kk = k - h*AMREX_D_PICK(0,0,1); kk <= k + h*AMREX_D_PICK(0,0,1); ++kk) {
+            for (int jj = j - h*AMREX_D_PICK(0,1,1); jj <= j + h*AMREX_D_PICK(0,1,1); ++jj) {
+            for (int ii = i - h; ii <= i + h; ++ii) {
+                phi_max = amrex::max(phi_max, phi_arr(ii,jj,kk));
+            }}}
+
+            const bool live = vol_arr(i,j,k) > 0.0 && phi_max > 0.0 && phi_max >= density_cutoff;
+            pcount[c] = live ? nppc : 0;
+        });
+
+        const int total = Scan::ExclusiveSum(ncells, pcount, poffset, Scan::retSum);
+        if (total == 0) continue;
+
+        const Long pid = ParticleType::NextID();
+        ParticleType::NextID(pid + total);
+
+        auto& ptile = DefineAndReturnParticleTile(lev, mfi.index(), mfi.LocalTileIndex());
+        const int old_size = ptile.numParticles();
+        ptile.resize(old_size + total);
+        ParticleType* pstruct = ptile.GetArrayOfStructs()().data() + old_size;
+        Real* AMREX_RESTRICT wp = ptile.GetStructOfArrays().GetRealData(PIdx::Weight).data() + old_size;
+
+        amrex::ParallelForRNG(tile_box,
+        [=] AMREX_GPU_DEVICE (int i, int j, int k, amrex::RandomEngine const& engine)
+        {
+            const int c = (i-lo.x) + len.x*((j-lo.y) + len.y*(k-lo.z));
+            const int start = poffset[c];
+            const int iv[] = {AMREX_D_DECL(i, j, k)};
+            if (pcount[c] == 0) return;
+
+            constexpr int bases[] = {2, 3, 5};
+            Real shift[AMREX_SPACEDIM] = {};
+            if (seeding == Seeding::Halton) {
+                for (int d = 0; d < AMREX_SPACEDIM; ++d) shift[d] = amrex::Random(engine);
+            }
+
+            for (int m = 0; m < pcount[c]; ++m)
+            {
+                ParticleType& p = pstruct[start + m];
+                p.id()  = pid + start + m;
+                p.cpu() = cpu;
+
+                // the position in the cell, in [0,1) per direction
+                Real r[AMREX_SPACEDIM];
+                int sub = m;
+                for (int d = 0; d < AMREX_SPACEDIM; ++d)
+                {
+                    if (nppc == 1) {
+                        r[d] = 0.5;
+                    } else if (seeding == Seeding::Halton) {
+                        r[d] = radical_inverse(m+1, bases[d]) + shift[d];
+                        if (r[d] >= 1.0) r[d] -= 1.0;
+                    } else if (seeding == Seeding::Jittered && m < nstrata) {
+                        r[d] = (sub % nsub + amrex::Random(engine)) / nsub;
+                        sub /= nsub;
+                    } else {
+                        r[d] = amrex::Random(engine);
+                    }
+                }
+
+                for (int d = 0; d < AMREX_SPACEDIM; ++d) {
+                    p.pos(d) = plo[d] + (iv[d] + r[d])*dx[d];
+                }
+                wp[start + m] = 0.0;
+            }
+        });
+
+        // counts and offsets are freed at the end of the iteration
+        Gpu::streamSynchronize();
     }
 
     // Interpolate from density field phi to set particle weights
@@ -32,8 +165,72 @@ FluidParticleContainer::InitParticles(const MultiFab& phi, const MultiFab& ebvol
     // or where density < density_cutoff
     RemoveCoveredParticles(ebvol, density_cutoff);
 
-    // Redistribute to remove the EB-covered particles based on the invalid IDs 
+    // Redistribute to remove the particles below the cutoff based on the invalid IDs 
     Redistribute();
+
+    // The particles were created cell by cell, but removing the invalid ones reorders them
+    if (m_sort_displacement > 0.0) {
+        SortByCell();
+    }
+}
+
+//
+// Sort the particles of each tile by cell, so the particles of a cell are
+// contiguous in memory and the kernels gather the mesh data in cell order
+//
+void
+FluidParticleContainer::SortByCell ()
+{
+    BL_PROFILE("FluidParticleContainer::SortByCell()");
+    const Real strttime = amrex::second();
+    SortParticlesByCell();
+    m_displacement = 0.0;
+    ++m_nsorts;
+    AddKernelTime(PKernel::Sort, strttime);
+}
+
+//
+// Sort once the particles may have moved sort_displacement cells since the last sort.
+// The bins are the cells of the tile box, so the sort waits while particles of this
+// rank are outside their tile box (until the next Redistribute).
+//
+bool
+FluidParticleContainer::SortIfDisplaced ()
+{
+    if (m_sort_displacement <= 0.0 || m_displacement < m_sort_displacement) return false;
+    if (m_out_of_box > 0.0) return false;
+    SortByCell();
+    return true;
+}
+
+//
+// With a redistribute margin, particles may stay in their tile until one lies more
+// than margin cells outside its tile box; the ghost cells of umac and phi cover the
+// margin. A step moves a particle less than a cell (cfl < 1), so when this fires
+// no particle is more than margin + 1 cells outside its tile box, and Redistribute
+// is told so (local). Without a margin, Redistribute every call.
+//
+bool
+FluidParticleContainer::RedistributeIfDisplaced ()
+{
+    if (m_redistribute_margin > 0)
+    {
+        Real out = m_out_of_box;
+        ParallelDescriptor::ReduceRealMax(out);
+        if (out <= m_redistribute_margin) return false;
+    }
+
+    BL_PROFILE("FluidParticleContainer::RedistributeIfDisplaced()");
+    const Real strttime = amrex::second();
+    if (m_redistribute_margin > 0) {
+        Redistribute(0, 0, 0, m_redistribute_margin + 1);
+    } else {
+        Redistribute();
+    }
+    m_out_of_box = 0.0;
+    ++m_nredistributes;
+    AddKernelTime(PKernel::Redistribute, strttime);
+    return true;
 }
 
 //
@@ -42,20 +239,69 @@ FluidParticleContainer::InitParticles(const MultiFab& phi, const MultiFab& ebvol
 Real
 FluidParticleContainer::SumPhi()
 {
+    const Real strttime = amrex::second();
+
     const auto geom = Geom(0);
-    const auto plo = geom.ProbLoArray();
-    const auto dxi = geom.InvCellSizeArray();
     const auto dx  = geom.CellSizeArray();
     const Real cell_volume = AMREX_D_TERM(dx[0], *dx[1], *dx[2]);
     const Real volume_per_particle = cell_volume / NumParticlesPerCell();
 
-    using PType = typename FluidParticleContainer::SuperParticleType;
-    Real sum_phi = amrex::ReduceSum(*this, [=] AMREX_GPU_HOST_DEVICE (const PType& p) -> Real { return p.rdata(PIdx::Weight) / volume_per_particle; });
+    ReduceOps<ReduceOpSum> reduce_op;
+    ReduceData<Real> reduce_data(reduce_op);
+    using ReduceTuple = typename decltype(reduce_data)::Type;
+
+    for (ParIterType pti(*this, 0); pti.isValid(); ++pti)
+    {
+        const Real* AMREX_RESTRICT wp = pti.GetStructOfArrays().GetRealData(PIdx::Weight).data();
+        reduce_op.eval(pti.numParticles(), reduce_data,
+        [=] AMREX_GPU_DEVICE (int i) -> ReduceTuple { return wp[i]; });
+    }
+
+    Real sum_phi = amrex::get<0>(reduce_data.value()) / volume_per_particle;
+
+    AddKernelTime(PKernel::SumPhi, strttime);
 
     ParallelDescriptor::ReduceRealSum(sum_phi);
     return sum_phi;
 }
 
+//
+// Accumulate the time of a kernel started at strttime and the particles it processed
+//
+void
+FluidParticleContainer::AddKernelTime (int kernel, Real strttime)
+{
+    Gpu::streamSynchronize();
+    m_kernel_time[kernel] += amrex::second() - strttime;
+    m_kernel_particles[kernel] += NumberOfParticlesAtLevel(0, false, true);
+}
+
+//
+// Print the particles per second of each kernel: particles over all ranks
+// divided by the largest time of a rank
+//
+void
+FluidParticleContainer::PrintKernelStats () const
+{
+    static const char* names[] = {"AdvectWithUmac", "DepositToMesh", "InterpolateFromMesh",
+                                  "SumPhi", "RemoveCoveredParticles", "SortByCell", "Redistribute",
+                                  "ManageParticles"};
+
+    Vector<Real> time(m_kernel_time, m_kernel_time + PKernel::NumKernels);
+    Vector<Long> count(m_kernel_particles, m_kernel_particles + PKernel::NumKernels);
+    ParallelDescriptor::ReduceRealMax(time.data(), time.size());
+    ParallelDescriptor::ReduceLongSum(count.data(), count.size());
+
+    amrex::Print() << "\nParticle kernel throughput\n";
+    for (int n = 0; n < PKernel::NumKernels; ++n)
+    {
+        if (count[n] == 0) continue;
+        amrex::Print() << "  " << std::left << std::setw(24) << names[n] << std::right
+                       << std::setw(14) << count[n] << " particles in " << std::setw(10) << time[n]
+                       << " s, " << (time[n] > 0.0 ? count[n]/time[n] : 0.0) << " particles/s\n";
+    }
+}
+
 //
 // Uses midpoint method to advance particles using umac.
 //
@@ -104,55 +350,81 @@ FluidParticleContainer::AdvectWithUmac (MultiFab* umac, int lev, Real dt)
         }
     }
 
-    for (int ipass = 0; ipass < 2; ipass++)
-    {
+    // one sweep: the midpoint position stays in registers, since umac does not
+    // change between the half and the full step. The largest displacement in
+    // cells of this step and the farthest any particle now lies outside its
+    // tile box (in cells) are reduced in the same sweep.
+    ReduceOps<ReduceOpMax, ReduceOpMax> reduce_op;
+    ReduceData<Real, Real> reduce_data(reduce_op);
+    using ReduceTuple = typename decltype(reduce_data)::Type;
+
 #ifdef _OPENMP
 #pragma omp parallel if (Gpu::notInLaunchRegion())
 #endif
-        for (ParIterType pti(*this, lev); pti.isValid(); ++pti)
+    for (ParIterType pti(*this, lev); pti.isValid(); ++pti)
+    {
+        int grid    = pti.index();
+        auto& aos   = pti.GetArrayOfStructs();
+        const int n = aos.numParticles();
+        auto p_pbox = aos().data();
+        const auto tlo = amrex::lbound(pti.tilebox());
+        const auto thi = amrex::ubound(pti.tilebox());
+        const FArrayBox* fab[AMREX_SPACEDIM] = { AMREX_D_DECL(&((*umac_pointer[0])[grid]),
+                                                              &((*umac_pointer[1])[grid]),
+                                                              &((*umac_pointer[2])[grid])) };
+
+        //array of these pointers to pass to the GPU
+        amrex::GpuArray<amrex::Array4<const Real>, AMREX_SPACEDIM>
+            const umacarr {{AMREX_D_DECL((*fab[0]).array(),
+                                         (*fab[1]).array(),
+                                         (*fab[2]).array() )}};
+
+        reduce_op.eval(n, reduce_data,
+        [=] AMREX_GPU_DEVICE (int i) -> ReduceTuple
         {
-            int grid    = pti.index();
-            auto& ptile = ParticlesAt(lev, pti);
-            auto& aos  = ptile.GetArrayOfStructs();
-            const int n = aos.numParticles();
-            auto p_pbox = aos().data();
-            const FArrayBox* fab[AMREX_SPACEDIM] = { AMREX_D_DECL(&((*umac_pointer[0])[grid]),
-                                                                  &((*umac_pointer[1])[grid]),
-                                                                  &((*umac_pointer[2])[grid])) };
-
-            //array of these pointers to pass to the GPU
-            amrex::GpuArray<amrex::Array4<const Real>, AMREX_SPACEDIM>
-                const umacarr {{AMREX_D_DECL((*fab[0]).array(),
-                                             (*fab[1]).array(),
-                                             (*fab[2]).array() )}};
-
-            amrex::ParallelFor(n,
-                               [=] AMREX_GPU_DEVICE (int i)
+            ParticleType& p = p_pbox[i];
+            if (p.id() <= 0) return {0.0, 0.0};
+
+            Real v[AMREX_SPACEDIM];
+            mac_interpolate(p, plo, dxi, umacarr, v);
+
+            // interpolate at the midpoint, then step from the old position
+            ParticleType pmid = p;
+            for (int dim=0; dim < AMREX_SPACEDIM; dim++) {
+                pmid.pos(dim) += 0.5*dt*v[dim];
+            }
+            mac_interpolate(pmid, plo, dxi, umacarr, v);
+
+            Real u = 0.0;
+            for (int dim=0; dim < AMREX_SPACEDIM; dim++)
             {
-                ParticleType& p = p_pbox[i];
-                if (p.id() <= 0) return;
-                Real v[AMREX_SPACEDIM];
-                mac_interpolate(p, plo, dxi, umacarr, v);
-                if (ipass == 0)
-                {
-                    for (int dim=0; dim < AMREX_SPACEDIM; dim++)
-                    {
-                        p.rdata(dim) = p.pos(dim);
-                        p.pos(dim) += 0.5*dt*v[dim];
-                    }
-                }
-                else
-                {
-                    for (int dim=0; dim < AMREX_SPACEDIM; dim++)
-                    {
-                        p.pos(dim) = p.rdata(dim) + dt*v[dim];
-                        p.rdata(dim) = v[dim];
-                    }
-                }
-            });
-        }
+                p.pos(dim) += dt*v[dim];
+                u = amrex::max(u, amrex::Math::abs(v[dim]) * dxi[dim]);
+            }
+
+            const Real x[] = {AMREX_D_DECL((p.pos(0) - plo[0]) * dxi[0],
+                                           (p.pos(1) - plo[1]) * dxi[1],
+                                           (p.pos(2) - plo[2]) * dxi[2])};
+            Real out = 0.0;
+            AMREX_D_TERM(out = amrex::max(out, amrex::max(tlo.x - x[0], x[0] - (thi.x+1)));,
+                         out = amrex::max(out, amrex::max(tlo.y - x[1], x[1] - (thi.y+1)));,
+                         out = amrex::max(out, amrex::max(tlo.z - x[2], x[2] - (thi.z+1))););
+            return {u, out};
+        });
     }
 
+    ReduceTuple hv = reduce_data.value();
+    m_out_of_box = amrex::get<1>(hv);
+
+    if (m_sort_displacement > 0.0)
+    {
+        Real umax = amrex::get<0>(hv);
+        ParallelDescriptor::ReduceRealMax(umax);
+        m_displacement += umax * dt;
+    }
+
+    AddKernelTime(PKernel::Advect, strttime);
+
     if (m_verbose > 1)
     {
         Real stoptime = amrex::second() - strttime;
@@ -170,61 +442,242 @@ FluidParticleContainer::AdvectWithUmac (MultiFab* umac, int lev, Real dt)
     }
 }
 
+namespace {
+
+//
+// Bin the np particles of a tile by their cell in the tile box bx
+// (cell index i + nx*(j + ny*k) relative to the box)
+//
+template <typename P>
+void bin_by_cell (DenseBins<P>& bins, const P* pstruct, int np, const Box& bx,
+                  GpuArray<Real,AMREX_SPACEDIM> const& plo, GpuArray<Real,AMREX_SPACEDIM> const& dxi)
+{
+    const auto lo = amrex::lbound(bx);
+    const auto hi = amrex::ubound(bx);
+    const auto len = amrex::length(bx);
+    bins.build(np, pstruct, bx.numPts(),
+    [=] AMREX_GPU_HOST_DEVICE (const P& p) -> int
+    {
+        int c[] = {0, 0, 0};
+        for (int d = 0; d < AMREX_SPACEDIM; ++d) {
+            c[d] = static_cast<int>(amrex::Math::floor((p.pos(d) - plo[d]) * dxi[d]));
+        }
+        c[0] = amrex::min(amrex::max(c[0], lo.x), hi.x);
+        c[1] = amrex::min(amrex::max(c[1], lo.y), hi.y);
+        c[2] = amrex::min(amrex::max(c[2], lo.z), hi.z);
+        return (c[0]-lo.x) + len.x*((c[1]-lo.y) + len.y*(c[2]-lo.z));
+    });
+}
+
+}
+
 //
-// Deposit the particle weights to the mesh to set the number density phi
+// Deposit the particle weights to the mesh to set the number density phi.
+// The shape is chosen here, once, so the stencil loops of the kernels unroll.
 //
 void
-FluidParticleContainer::DepositToMesh (MultiFab& phi, int interpolation)
+FluidParticleContainer::DepositToMesh (MultiFab& phi, int interpolation, int deposit)
 {
-    const auto geom = Geom(0);
+    const Real strttime = amrex::second();
+
+    AMREX_ALWAYS_ASSERT(phi.nGrow() >= shape_halfwidth(interpolation));
+
+#ifndef AMREX_USE_GPU
+    if (deposit == Deposit::TilePrivate) {
+        DepositToMeshPrivate(phi, interpolation);
+        AddKernelTime(PKernel::Deposit, strttime);
+        return;
+    }
+#else
+    amrex::ignore_unused(deposit);
+#endif
+
+    switch (interpolation)
+    {
+    case Interpolation::NGP: DepositAtomic<ShapeNGP>(phi); break;
+    case Interpolation::CIC: DepositAtomic<ShapeCIC>(phi); break;
+    case Interpolation::TSC: DepositAtomic<ShapeTSC>(phi); break;
+    case Interpolation::QSP: DepositAtomic<ShapeQSP>(phi); break;
+    default: amrex::Abort("DepositToMesh: unknown pic_interpolation");
+    }
+
+    AddKernelTime(PKernel::Deposit, strttime);
+}
+
+void
+FluidParticleContainer::DepositToMeshPrivate (MultiFab& phi, int interpolation)
+{
+    switch (interpolation)
+    {
+    case Interpolation::NGP: DepositPrivate<ShapeNGP>(phi); break;
+    case Interpolation::CIC: DepositPrivate<ShapeCIC>(phi); break;
+    case Interpolation::TSC: DepositPrivate<ShapeTSC>(phi); break;
+    case Interpolation::QSP: DepositPrivate<ShapeQSP>(phi); break;
+    default: amrex::Abort("DepositToMeshPrivate: unknown pic_interpolation");
+    }
+}
+
+//
+// Deposit with one atomic add per particle and stencil cell
+//
+template <typename S>
+void
+FluidParticleContainer::DepositAtomic (MultiFab& phi)
+{
+    const int lev = 0;
+    AMREX_ALWAYS_ASSERT(OnSameGrids(lev, phi));
+
+    const auto geom = Geom(lev);
     const auto plo = geom.ProbLoArray();
     const auto dxi = geom.InvCellSizeArray();
     const Real inv_cell_volume = AMREX_D_TERM(dxi[0], *dxi[1], *dxi[2]);
-    amrex::ParticleToMesh(*this, phi, 0,
-    [=] AMREX_GPU_DEVICE (const FluidParticleContainer::ParticleType& p,
-                          amrex::Array4<amrex::Real> const& phi_arr)
+
+    phi.setVal(0.0);
+
+#ifdef _OPENMP
+#pragma omp parallel if (Gpu::notInLaunchRegion())
+#endif
+    for (ParIterType pti(*this, lev); pti.isValid(); ++pti)
+    {
+        const ParticleType* pstruct = pti.GetArrayOfStructs()().data();
+        const Real* AMREX_RESTRICT wp = pti.GetStructOfArrays().GetRealData(PIdx::Weight).data();
+        amrex::Array4<amrex::Real> const& phi_arr = phi.array(pti);
+
+        amrex::ParallelFor(pti.numParticles(),
+        [=] AMREX_GPU_DEVICE (int n)
+        {
+            const Real w_n = wp[n] * inv_cell_volume;
+
+            // Add up the number of physical particles represented by our particle weights to the grid
+            // and divide by the cell volume to get the number density on the grid.
+            for_each_stencil_cell<S>(pstruct[n], plo, dxi,
+            [&] (int i, int j, int k, amrex::Real w)
+            {
+                amrex::HostDevice::Atomic::Add(&phi_arr(i, j, k), w * w_n);
+            });
+        });
+    }
+
+    // add the deposits into ghost cells to the grids that own them
+    phi.SumBoundary(geom.periodicity());
+}
+
+//
+// Deposit without atomics: every particle tile accumulates into a private buffer
+// covering its tile box and ghost layer, then the buffers of each grid are added
+// to phi in tile order, so the result does not depend on the thread schedule.
+// The particles are visited cell by cell, accumulating the cells around each
+// cell locally before they are added to the buffer once.
+//
+template <typename S>
+void
+FluidParticleContainer::DepositPrivate (MultiFab& phi)
+{
+    BL_PROFILE("FluidParticleContainer::DepositToMeshPrivate()");
+
+    using Cache = StencilCache<S::halfwidth>;
+
+    const int lev = 0;
+    AMREX_ALWAYS_ASSERT(OnSameGrids(lev, phi));
+
+    const auto geom = Geom(lev);
+    const auto plo = geom.ProbLoArray();
+    const auto dxi = geom.InvCellSizeArray();
+    const Real inv_cell_volume = AMREX_D_TERM(dxi[0], *dxi[1], *dxi[2]);
+
+    // the particle tiles of this rank, in iteration order (grid by grid)
+    Vector<int> tile_grid;
+    Vector<int> tile_index;
+    Vector<Box> tile_box;
+    for (ParIterType pti(*this, lev); pti.isValid(); ++pti) {
+        tile_grid.push_back(pti.index());
+        tile_index.push_back(pti.LocalTileIndex());
+        tile_box.push_back(amrex::grow(pti.tilebox(), phi.nGrow()));
+    }
+    const int ntiles = tile_grid.size();
+
+    Vector<FArrayBox> buffers(ntiles);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int t = 0; t < ntiles; ++t)
     {
-        AMREX_D_TERM(
-            amrex::Real lx = (p.pos(0) - plo[0]) * dxi[0] + 0.5;,
-            amrex::Real ly = (p.pos(1) - plo[1]) * dxi[1] + 0.5;,
-            amrex::Real lz = (p.pos(2) - plo[2]) * dxi[2] + 0.5;
-        );
-
-        int i = 0;
-        int j = 0;
-        int k = 0;
-
-        AMREX_D_TERM(
-            i = amrex::Math::floor(lx);,
-            j = amrex::Math::floor(ly);,
-            k = amrex::Math::floor(lz);
-        );
-
-        AMREX_D_TERM(
-            amrex::Real xint = lx - i;,
-            amrex::Real yint = ly - j;,
-            amrex::Real zint = lz - k;
-        );
-
-        // Nearest Grid Point Interpolation (NGP)
-        amrex::Real sx[] = {0.0, 1.0};
-        amrex::Real sy[] = {0.0, 1.0};
-        amrex::Real sz[] = {0.0, 1.0};
-
-        // Cloud In Cell interpolation (CIC)
-        if (interpolation == Interpolation::CIC) {
-            AMREX_D_EXPR(sx[0] = 1.-xint, sy[0] = 1.-yint, sz[0] = 1.-zint);
-            AMREX_D_EXPR(sx[1] =    xint, sy[1] =    yint, sz[1] =    zint);
+        FArrayBox& buf = buffers[t];
+        buf.resize(tile_box[t], 1);
+        buf.setVal<RunOn::Host>(0.0);
+        Array4<Real> const& b = buf.array();
+
+        const auto& ptile = ParticlesAt(lev, tile_grid[t], tile_index[t]);
+        const auto& aos = ptile.GetArrayOfStructs();
+        const ParticleType* pstruct = aos().data();
+        const Real* AMREX_RESTRICT wp = ptile.GetStructOfArrays().GetRealData(PIdx::Weight).data();
+        const int np = aos.numParticles();
+        if (np == 0) continue;
+
+        const Box& bx = amrex::grow(tile_box[t], -phi.nGrow());
+        DenseBins<ParticleType> bins;
+        bin_by_cell(bins, pstruct, np, bx, plo, dxi);
+        const auto offsets = bins.offsetsPtr();
+        const auto perm = bins.permutationPtr();
+        const auto lo = amrex::lbound(bx);
+        const auto len = amrex::length(bx);
+
+        amrex::LoopOnCpu(bx, [&] (int i, int j, int k)
+        {
+            const int bin = (i-lo.x) + len.x*((j-lo.y) + len.y*(k-lo.z));
+            const auto start = offsets[bin];
+            const auto stop = offsets[bin+1];
+            if (start == stop) return;
+
+            Real acc[Cache::size] = {};
+            for (auto n = start; n < stop; ++n)
+            {
+                const auto pid = perm[n];
+                const Real w_n = wp[pid] * inv_cell_volume;
+                for_each_stencil_cell<S>(pstruct[pid], plo, dxi,
+                [&] (int ci, int cj, int ck, amrex::Real w)
+                {
+                    const int s = Cache::index(ci, cj, ck, i, j, k);
+                    if (s >= 0) {
+                        acc[s] += w * w_n;
+                    } else {
+                        b(ci, cj, ck) += w * w_n;
+                    }
+                });
+            }
+
+            for (int s = 0; s < Cache::size; ++s) {
+                int ci, cj, ck;
+                Cache::cell(s, i, j, k, ci, cj, ck);
+                b(ci, cj, ck) += acc[s];
+            }
+        });
+    }
+
+    phi.setVal(0.0);
+
+    // the tiles of a grid are contiguous; each grid is reduced by one thread
+    Vector<int> grid_start;
+    for (int t = 0; t < ntiles; ++t) {
+        if (t == 0 || tile_grid[t] != tile_grid[t-1]) grid_start.push_back(t);
+    }
+    grid_start.push_back(ntiles);
+    const int ngrids = grid_start.size() - 1;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int g = 0; g < ngrids; ++g)
+    {
+        FArrayBox& fab = phi[tile_grid[grid_start[g]]];
+        for (int t = grid_start[g]; t < grid_start[g+1]; ++t) {
+            const Box bx = tile_box[t] & fab.box();
+            fab.plus<RunOn::Host>(buffers[t], bx, bx, 0, 0, 1);
         }
+    }
 
-        // Add up the number of physical particles represented by our particle weights to the grid
-        // and divide by the cell volume to get the number density on the grid.
-        for (int kk = AMREX_D_PICK(1, 1, 0); kk <= 1; ++kk) { 
-        for (int jj = AMREX_D_PICK(1, 0, 0); jj <= 1; ++jj) {
-        for (int ii = 0; ii <= 1; ++ii) {
-            amrex::Gpu::Atomic::Add(&phi_arr(i+ii-1, j+jj-1, k+kk-1), sx[ii]*sy[jj]*sz[kk] * p.rdata(PIdx::Weight) * inv_cell_volume);
-        }}}
-    });
+    phi.SumBoundary(geom.periodicity());
 }
 
 //
@@ -233,65 +686,105 @@ FluidParticleContainer::DepositToMesh (MultiFab& phi, int interpolation)
 void
 FluidParticleContainer::InterpolateFromMesh (const MultiFab& phi, int interpolation)
 {
-    const auto geom = Geom(0);
+    const Real strttime = amrex::second();
+
+    AMREX_ALWAYS_ASSERT(phi.nGrow() >= shape_halfwidth(interpolation));
+
+    switch (interpolation)
+    {
+    case Interpolation::NGP: InterpolateShape<ShapeNGP>(phi); break;
+    case Interpolation::CIC: InterpolateShape<ShapeCIC>(phi); break;
+    case Interpolation::TSC: InterpolateShape<ShapeTSC>(phi); break;
+    case Interpolation::QSP: InterpolateShape<ShapeQSP>(phi); break;
+    default: amrex::Abort("InterpolateFromMesh: unknown pic_interpolation");
+    }
+
+    AddKernelTime(PKernel::Interpolate, strttime);
+}
+
+//
+// The particles of each tile are visited cell by cell, so the mesh values
+// around a cell are loaded once for all of its particles.
+//
+template <typename S>
+void
+FluidParticleContainer::InterpolateShape (const MultiFab& phi)
+{
+    BL_PROFILE("FluidParticleContainer::InterpolateFromMesh()");
+
+    using Cache = StencilCache<S::halfwidth>;
+
+    const int lev = 0;
+    AMREX_ALWAYS_ASSERT(OnSameGrids(lev, phi));
+
+    const auto geom = Geom(lev);
     const auto plo = geom.ProbLoArray();
     const auto dxi = geom.InvCellSizeArray();
     const auto dx  = geom.CellSizeArray();
     const Real cell_volume = AMREX_D_TERM(dx[0], *dx[1], *dx[2]);
     const Real volume_per_particle = cell_volume / NumParticlesPerCell();
 
-    amrex::MeshToParticle(*this, phi, 0,
-    [=] AMREX_GPU_DEVICE (FluidParticleContainer::ParticleType& p,
-                          amrex::Array4<const amrex::Real> const& phi_arr)
+#ifdef _OPENMP
+#pragma omp parallel if (Gpu::notInLaunchRegion())
+#endif
+    for (ParIterType pti(*this, lev); pti.isValid(); ++pti)
     {
-        AMREX_D_TERM(
-            amrex::Real lx = (p.pos(0) - plo[0]) * dxi[0] + 0.5;,
-            amrex::Real ly = (p.pos(1) - plo[1]) * dxi[1] + 0.5;,
-            amrex::Real lz = (p.pos(2) - plo[2]) * dxi[2] + 0.5;
-        );
-
-        int i = 0;
-        int j = 0;
-        int k = 0;
-
-        AMREX_D_TERM(
-            i = amrex::Math::floor(lx);,
-            j = amrex::Math::floor(ly);,
-            k = amrex::Math::floor(lz);
-        );
-
-        AMREX_D_TERM(
-            amrex::Real xint = lx - i;,
-            amrex::Real yint = ly - j;,
-            amrex::Real zint = lz - k;
-        );
-
-        // Nearest Grid Point Interpolation (NGP)
-        amrex::Real sx[] = {0.0, 1.0};
-        amrex::Real sy[] = {0.0, 1.0};
-        amrex::Real sz[] = {0.0, 1.0};
-
-        // Cloud In Cell interpolation (CIC)
-        if (interpolation == Interpolation::CIC) {
-            AMREX_D_EXPR(sx[0] = 1.-xint, sy[0] = 1.-yint, sz[0] = 1.-zint);
-            AMREX_D_EXPR(sx[1] =    xint, sy[1] =    yint, sz[1] =    zint);
-        }
+        auto& aos = pti.GetArrayOfStructs();
+        const ParticleType* pstruct = aos().data();
+        Real* AMREX_RESTRICT wp = pti.GetStructOfArrays().GetRealData(PIdx::Weight).data();
+        const int np = aos.numParticles();
+        if (np == 0) continue;
 
-        // The particle weight is the number of physical particles it represents.
-        // This is set from the number density in the grid phi in 2 steps:
+        const Box& bx = pti.tilebox();
+        amrex::Array4<const amrex::Real> const& phi_arr = phi.const_array(pti);
 
-        // Step 1: interpolate number density phi using the particle shape factor for CIC or NGP
-        amrex::Real interpolated_phi = 0.0;
+        DenseBins<ParticleType> bins;
+        bin_by_cell(bins, pstruct, np, bx, plo, dxi);
+        const auto offsets = bins.offsetsPtr();
+        const auto perm = bins.permutationPtr();
+        const auto lo = amrex::lbound(bx);
+        const auto len = amrex::length(bx);
 
-        for (int kk = AMREX_D_PICK(1, 1, 0); kk <= 1; ++kk) { 
-        for (int jj = AMREX_D_PICK(1, 0, 0); jj <= 1; ++jj) {
-        for (int ii = 0; ii <= 1; ++ii) {
-            interpolated_phi += sx[ii]*sy[jj]*sz[kk] * phi_arr(i+ii-1,j+jj-1,k+kk-1);
-        }}}
+        amrex::ParallelFor(bx,
+        [=] AMREX_GPU_DEVICE (int i, int j, int k)
+        {
+            const int bin = (i-lo.x) + len.x*((j-lo.y) + len.y*(k-lo.z));
+            const auto start = offsets[bin];
+            const auto stop = offsets[bin+1];
+            if (start == stop) return;
 
-        // Step 2: scale interpolated number density by the volume per particle and set particle weight
-        p.rdata(PIdx::Weight) = interpolated_phi * volume_per_particle;
-    });
+            // the mesh values around the cell, shared by all its particles
+            Real phi_s[Cache::size];
+            for (int s = 0; s < Cache::size; ++s) {
+                int ci, cj, ck;
+                Cache::cell(s, i, j, k, ci, cj, ck);
+                phi_s[s] = phi_arr(ci, cj, ck);
+            }
+
+            for (auto n = start; n < stop; ++n)
+            {
+                const auto pid = perm[n];
+
+                // The particle weight is the number of physical particles it represents.
+                // This is set from the number density in the grid phi in 2 steps:
+
+                // Step 1: interpolate number density phi using the particle shape factor
+                amrex::Real interpolated_phi = 0.0;
+                for_each_stencil_cell<S>(pstruct[pid], plo, dxi,
+                [&] (int ci, int cj, int ck, amrex::Real w)
+                {
+                    const int s = Cache::index(ci, cj, ck, i, j, k);
+                    interpolated_phi += w * ((s >= 0) ? phi_s[s] : phi_arr(ci, cj, ck));
+                });
+
+                // Step 2: scale interpolated number density by the volume per particle and set particle weight
+                wp[pid] = interpolated_phi * volume_per_particle;
+            }
+        });
+
+        // the bins are freed at the end of the iteration
+        Gpu::streamSynchronize();
+    }
 }
 
 //
@@ -310,36 +803,225 @@ FluidParticleContainer::RemoveCoveredParticles (const MultiFab& ebvol, const Rea
     // Get the particle weight corresponding to the density cutoff on the grid
     const amrex::Real weight_cutoff = density_cutoff * volume_per_particle;
 
-    amrex::MeshToParticle(*this, ebvol, 0,
-    [=] AMREX_GPU_DEVICE (FluidParticleContainer::ParticleType& p,
-                          amrex::Array4<const amrex::Real> const& vol_arr)
+    const Real strttime = amrex::second();
+
+    const int lev = 0;
+    AMREX_ALWAYS_ASSERT(OnSameGrids(lev, ebvol));
+
+#ifdef _OPENMP
+#pragma omp parallel if (Gpu::notInLaunchRegion())
+#endif
+    for (ParIterType pti(*this, lev); pti.isValid(); ++pti)
     {
-        AMREX_D_TERM(
-            amrex::Real lx = (p.pos(0) - plo[0]) * dxi[0] + 0.5;,
-            amrex::Real ly = (p.pos(1) - plo[1]) * dxi[1] + 0.5;,
-            amrex::Real lz = (p.pos(2) - plo[2]) * dxi[2] + 0.5;
-        );
-
-        int i = 0;
-        int j = 0;
-        int k = 0;
-
-        AMREX_D_TERM(
-            i = amrex::Math::floor(lx);,
-            j = amrex::Math::floor(ly);,
-            k = amrex::Math::floor(lz);
-        );
-
-        // Get the EB volume fraction of the cell this particle is in
-        const amrex::Real cell_vol = vol_arr(i,j,k);
-
-        // If the cell volume = 0, then the particle is covered by the EB
-        // so we want to delete the particle in the next call to Redistribute().
-        // We also delete the particle if the weight is zero or less than the cutoff weight.
-        if (cell_vol == 0.0 || p.rdata(PIdx::Weight) == 0.0 || p.rdata(PIdx::Weight) < weight_cutoff) {
-            p.id() = -1;
+        ParticleType* pstruct = pti.GetArrayOfStructs()().data();
+        const Real* AMREX_RESTRICT wp = pti.GetStructOfArrays().GetRealData(PIdx::Weight).data();
+        amrex::Array4<const amrex::Real> const& vol_arr = ebvol.const_array(pti);
+
+        amrex::ParallelFor(pti.numParticles(),
+        [=] AMREX_GPU_DEVICE (int n)
+        {
+            ParticleType& p = pstruct[n];
+
+            // the cell this particle is in
+            int i = 0, j = 0, k = 0;
+            for_each_stencil_cell<ShapeNGP>(p, plo, dxi,
+            [&] (int ci, int cj, int ck, amrex::Real)
+            {
+                i = ci; j = cj; k = ck;
+            });
+
+            // Get the EB volume fraction of the cell this particle is in
+            const amrex::Real cell_vol = vol_arr(i,j,k);
+
+            // If the cell volume = 0, then the particle is covered by the EB
+            // so we want to delete the particle in the next call to Redistribute().
+            // We also delete the particle if the weight is zero or less than the cutoff weight.
+            if (cell_vol == 0.0 || wp[n] == 0.0 || wp[n] < weight_cutoff) {
+                p.id() = -1;
+            }
+        });
+    }
+
+    AddKernelTime(PKernel::RemoveCovered, strttime);
+}
+
+//
+// Hold the particles per cell between ppc_min and ppc_max: in a cell with more than
+// ppc_max particles the two lightest are merged (weights added, placed at their
+// weighted centroid) until ppc_max are left; in a cell with fewer than ppc_min the
+// heaviest is split in two halves placed symmetrically about it, along the direction
+// with the most room and inside its cell, until there are ppc_min. Both conserve the
+// total weight and its first moments exactly. Runs on the host (CPU builds only).
+//
+void
+FluidParticleContainer::ManageParticles (int ppc_min, int ppc_max)
+{
+    BL_PROFILE("FluidParticleContainer::ManageParticles()");
+
+#ifdef AMREX_USE_GPU
+    amrex::ignore_unused(ppc_min, ppc_max);
+    amrex::Abort("ManageParticles: particle splitting and merging is CPU only");
+#else
+    const Real strttime = amrex::second();
+
+    const int lev = 0;
+    const auto geom = Geom(lev);
+    const auto plo = geom.ProbLoArray();
+    const auto dx  = geom.CellSizeArray();
+    const auto dxi = geom.InvCellSizeArray();
+
+    // a particle of a cell: its position, weight and index in the tile (-1 if new)
+    struct Rec {
+        Real pos[AMREX_SPACEDIM];
+        Real w;
+        int idx;
+    };
+    auto lighter = [] (const Rec& a, const Rec& b) { return a.w > b.w; };
+    auto heavier = [] (const Rec& a, const Rec& b) { return a.w < b.w; };
+
+    Long nmerged = 0;
+    Long nsplit = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel reduction(+:nmerged,nsplit)
+#endif
+    for (ParIterType pti(*this, lev); pti.isValid(); ++pti)
+    {
+        auto& ptile = ParticlesAt(lev, pti);
+        auto& aos = ptile.GetArrayOfStructs();
+        ParticleType* pstruct = aos().data();
+        Real* wp = ptile.GetStructOfArrays().GetRealData(PIdx::Weight).data();
+        const int np = aos.numParticles();
+        if (np == 0) continue;
+
+        const Box& bx = pti.tilebox();
+        DenseBins<ParticleType> bins;
+        bin_by_cell(bins, pstruct, np, bx, plo, dxi);
+        const auto offsets = bins.offsetsPtr();
+        const auto perm = bins.permutationPtr();
+        const auto lo = amrex::lbound(bx);
+        const auto len = amrex::length(bx);
+
+        Vector<Rec> added;
+        Vector<Rec> recs;
+
+        amrex::LoopOnCpu(bx, [&] (int i, int j, int k)
+        {
+            const int bin = (i-lo.x) + len.x*((j-lo.y) + len.y*(k-lo.z));
+            const int start = offsets[bin];
+            const int stop = offsets[bin+1];
+            const int n = stop - start;
+            if (n == 0 || (n >= ppc_min && n <= ppc_max)) return;
+
+            recs.clear();
+            for (int m = start; m < stop; ++m)
+            {
+                const int pid = perm[m];
+                Rec r;
+                for (int d = 0; d < AMREX_SPACEDIM; ++d) r.pos[d] = pstruct[pid].pos(d);
+                r.w = wp[pid];
+                r.idx = pid;
+                recs.push_back(r);
+            }
+
+            if (n > ppc_max)
+            {
+                std::priority_queue<Rec, Vector<Rec>, decltype(lighter)> q(lighter, recs);
+                while (static_cast<int>(q.size()) > ppc_max)
+                {
+                    Rec a = q.top(); q.pop();
+                    Rec b = q.top(); q.pop();
+                    if (a.idx < 0) std::swap(a, b);
+                    if (b.idx >= 0) pstruct[b.idx].id() = -1;
+
+                    const Real w = a.w + b.w;
+                    for (int d = 0; d < AMREX_SPACEDIM; ++d) {
+                        a.pos[d] = (w > 0.0) ? (a.w*a.pos[d] + b.w*b.pos[d]) / w
+                                             : 0.5*(a.pos[d] + b.pos[d]);
+                    }
+                    a.w = w;
+                    q.push(a);
+                    ++nmerged;
+                }
+                recs.clear();
+                for (; !q.empty(); q.pop()) recs.push_back(q.top());
+            }
+            else
+            {
+                std::priority_queue<Rec, Vector<Rec>, decltype(heavier)> q(heavier, recs);
+                while (static_cast<int>(q.size()) < ppc_min)
+                {
+                    Rec a = q.top(); q.pop();
+                    Rec b = a;
+                    b.idx = -1;
+
+                    // the direction with the most room to either face of the particle's cell
+                    int dsplit = 0;
+                    Real room = -1.0;
+                    for (int d = 0; d < AMREX_SPACEDIM; ++d) {
+                        const Real x = (a.pos[d] - plo[d]) * dxi[d];
+                        const Real f = x - std::floor(x);
+                        const Real r = amrex::min(f, Real(1.0) - f) * dx[d];
+                        if (r > room) { room = r; dsplit = d; }
+                    }
+                    a.pos[dsplit] -= 0.5*room;
+                    b.pos[dsplit] += 0.5*room;
+                    a.w *= 0.5;
+                    b.w = a.w;
+                    q.push(a);
+                    q.push(b);
+                    ++nsplit;
+                }
+                recs.clear();
+                for (; !q.empty(); q.pop()) recs.push_back(q.top());
+            }
+
+            for (const auto& r : recs)
+            {
+                if (r.idx < 0) {
+                    added.push_back(r);
+                    continue;
+                }
+                for (int d = 0; d < AMREX_SPACEDIM; ++d) pstruct[r.idx].pos(d) = r.pos[d];
+                wp[r.idx] = r.w;
+            }
+        });
+
+        // drop the merged particles and append the split ones
+        int nkeep = 0;
+        for (int m = 0; m < np; ++m)
+        {
+            if (pstruct[m].id() <= 0) continue;
+            if (nkeep != m) {
+                pstruct[nkeep] = pstruct[m];
+                wp[nkeep] = wp[m];
+            }
+            ++nkeep;
         }
-    });
+        ptile.resize(nkeep + added.size());
+        pstruct = aos().data();
+        wp = ptile.GetStructOfArrays().GetRealData(PIdx::Weight).data();
+
+        for (int m = 0; m < added.size(); ++m)
+        {
+            ParticleType& p = pstruct[nkeep + m];
+            p.id() = ParticleType::NextID();
+            p.cpu() = ParallelDescriptor::MyProc();
+            for (int d = 0; d < AMREX_SPACEDIM; ++d) p.pos(d) = added[m].pos[d];
+            wp[nkeep + m] = added[m].w;
+        }
+    }
+
+    m_nmerged += nmerged;
+    m_nsplit += nsplit;
+
+    // the tiles are no longer in cell order
+    if (m_sort_displacement > 0.0) {
+        m_displacement = m_sort_displacement;
+    }
+
+    AddKernelTime(PKernel::Manage, strttime);
+#endif
 }
 
 }
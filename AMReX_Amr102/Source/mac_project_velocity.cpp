@@ -1,9 +1,38 @@
+#include <memory>
+
+#include <AMReX.H>
+#include <AMReX_ParallelDescriptor.H>
 #include <hydro_MacProjector.H>
 
-void mac_project_velocity(amrex::Array<amrex::MultiFab,AMREX_SPACEDIM>& vel, const amrex::Geometry& geom, int use_hypre)
+using namespace amrex;
+using namespace Hydro;
+
+namespace {
+
+// The geometry, EB and beta never change, so the projector (and with it the
+// MLMG operator hierarchy and the EB coarsening) is built on the first call and
+// kept. phi holds the potential of the last solve, the initial guess of the next.
+struct MacProjection
+{
+    Array<MultiFab,AMREX_SPACEDIM> beta;
+    MultiFab phi;
+    std::unique_ptr<MacProjector> macproj;
+    int nsolves = 0;
+    int total_iters = 0;
+    Real total_time = 0.0;
+};
+
+std::unique_ptr<MacProjection> mac_projection;
+
+MacProjection&
+get_mac_projection (Array<MultiFab,AMREX_SPACEDIM>& vel, const Geometry& geom, int use_hypre)
 {
-    using namespace amrex;
-    using namespace Hydro;
+    if (mac_projection) return *mac_projection;
+
+    mac_projection = std::make_unique<MacProjection>();
+    amrex::ExecOnFinalize([] () { mac_projection.reset(); });
+
+    MacProjection& mp = *mac_projection;
 
     LPInfo lp_info;
 
@@ -11,34 +40,77 @@ void mac_project_velocity(amrex::Array<amrex::MultiFab,AMREX_SPACEDIM>& vel, con
     if (use_hypre) 
         lp_info.setMaxCoarseningLevel(0);
 
-    Array<MultiFab,AMREX_SPACEDIM> beta;
-
     for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
-        beta[idim].define(vel[idim].boxArray(), vel[idim].DistributionMap(), 1, 0, MFInfo(), vel[idim].Factory());
-        beta[idim].setVal(1.0);
+        mp.beta[idim].define(vel[idim].boxArray(), vel[idim].DistributionMap(), 1, 0, MFInfo(), vel[idim].Factory());
+        mp.beta[idim].setVal(1.0);
     }
 
-    MacProjector macproj({amrex::GetArrOfPtrs(vel)},       // mac velocity
+    const BoxArray grids = amrex::convert(vel[0].boxArray(), IntVect::TheZeroVector());
+    mp.phi.define(grids, vel[0].DistributionMap(), 1, 1, MFInfo(), vel[0].Factory());
+    mp.phi.setVal(0.0);
+
+    mp.macproj = std::make_unique<MacProjector>(
+                         Vector<Array<MultiFab*,AMREX_SPACEDIM>>{amrex::GetArrOfPtrs(vel)}, // mac velocity
                          MLMG::Location::FaceCenter,       // velocity located on face centers
-                         {amrex::GetArrOfConstPtrs(beta)}, // beta
+                         Vector<Array<MultiFab const*,AMREX_SPACEDIM>>{amrex::GetArrOfConstPtrs(mp.beta)}, // beta
                          MLMG::Location::FaceCenter,       // beta located on face centers
-		         MLMG::Location::CellCenter,       // location of mac_phi
-                         {geom},
+                         MLMG::Location::CellCenter,       // location of mac_phi
+                         Vector<Geometry>{geom},
                          lp_info);                          // structure for passing info to the operator
 
-        // Set bottom-solver to use hypre instead of native BiCGStab 
-        if (use_hypre) 
-           macproj.getMLMG().setBottomSolver(MLMG::BottomSolver::hypre);
+    // Set bottom-solver to use hypre instead of native BiCGStab 
+    if (use_hypre) 
+       mp.macproj->getMLMG().setBottomSolver(MLMG::BottomSolver::hypre);
+
+    // measure the tolerance against the norm of the rhs, not of the initial
+    // residual, so a warm start stops at the same accuracy as a cold one
+    mp.macproj->getMLMG().setAlwaysUseBNorm(true);
 
-        macproj.setDomainBC({AMREX_D_DECL(LinOpBCType::Neumann,
+    mp.macproj->setDomainBC({AMREX_D_DECL(LinOpBCType::Neumann,
                                           LinOpBCType::Neumann,
                                           LinOpBCType::Periodic)},
                             {AMREX_D_DECL(LinOpBCType::Neumann,
                                           LinOpBCType::Neumann,
                                           LinOpBCType::Periodic)});
 
-        Real reltol = 1.e-8;
-        Real abstol = 1.e-12;
+    return mp;
+}
+
+}
+
+void mac_project_velocity(Array<MultiFab,AMREX_SPACEDIM>& vel, const Geometry& geom, int use_hypre, int warm_start)
+{
+    MacProjection& mp = get_mac_projection(vel, geom, use_hypre);
+
+    mp.macproj->setUMAC({amrex::GetArrOfPtrs(vel)});
+
+    if (!warm_start) {
+        mp.phi.setVal(0.0);
+    }
+
+    Real reltol = 1.e-8;
+    Real abstol = 1.e-12;
+
+    const Real strttime = amrex::second();
+    mp.macproj->project({&mp.phi}, reltol, abstol);
+    Real solve_time = amrex::second() - strttime;
+    ParallelDescriptor::ReduceRealMax(solve_time);
+
+    const int iters = mp.macproj->getMLMG().getNumIters();
+    mp.nsolves++;
+    mp.total_iters += iters;
+    mp.total_time += solve_time;
+
+    amrex::Print() << "MAC projection: " << iters << " iterations in " << solve_time << " s"
+                   << (warm_start && mp.nsolves > 1 ? " (warm start)" : "") << std::endl;
+}
+
+void print_mac_projection_stats()
+{
+    if (!mac_projection || mac_projection->nsolves == 0) return;
 
-        macproj.project(reltol, abstol);
+    const MacProjection& mp = *mac_projection;
+    amrex::Print() << "\nMAC projection: " << mp.nsolves << " solves, "
+                   << Real(mp.total_iters)/mp.nsolves << " iterations and "
+                   << mp.total_time/mp.nsolves << " s per solve" << std::endl;
 }
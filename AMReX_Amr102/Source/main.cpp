@@ -21,7 +21,17 @@ using namespace amrex;
 
 extern void make_eb_cylinder(const Geometry& geom);
 extern void define_velocity(const Real time, const Geometry& geo, Array<MultiFab,AMREX_SPACEDIM>& vel_out, const MultiFab& phi);
-extern void mac_project_velocity(Array<MultiFab,AMREX_SPACEDIM>& vel_out, const Geometry& geom, int use_hypre); 
+extern void mac_project_velocity(Array<MultiFab,AMREX_SPACEDIM>& vel_out, const Geometry& geom, int use_hypre, int warm_start);
+extern void benchmark_seeding(const Geometry& geom, const DistributionMapping& dmap, const BoxArray& grids,
+                              const MultiFab& phi, const MultiFab& ebvol, Real phi_cutoff,
+                              const Vector<int>& ppc, int interpolation, int deposit, int nrep, Real target);
+extern void print_mac_projection_stats();
+extern void benchmark_deposit(const Geometry& geom, const DistributionMapping& dmap, const BoxArray& grids,
+                              const MultiFab& phi, const MultiFab& ebvol, Real phi_cutoff,
+                              const Vector<int>& ppc, int interpolation, int nrep);
+extern void benchmark_shapes(const Geometry& geom, const DistributionMapping& dmap, const BoxArray& grids,
+                             const MultiFab& phi, const MultiFab& ebvol, Real phi_cutoff,
+                             const Vector<int>& ppc, int deposit, int nrep);
 
 Real est_time_step(const Real current_dt, const Geometry& geom, Array<MultiFab,AMREX_SPACEDIM>& vel, const Real cfl)
 {
@@ -104,6 +114,20 @@ int main (int argc, char* argv[])
         int max_grid_size = 32;
         int n_ppc = 4;
         int pic_interpolation = Interpolation::CIC;
+        int deposit_mode = Deposit::Atomic;
+        int deposit_benchmark = 0;
+        Vector<int> deposit_benchmark_ppc {1, 8, 32, 100};
+        Real sort_displacement = 0.0;
+        int redistribute_margin = 0;
+        int seeding = Seeding::Random;
+        int seeding_benchmark = 0;
+        Vector<int> seeding_benchmark_ppc {4, 8, 16, 32, 64, 100};
+        Real seeding_benchmark_target = 0.0;
+        int manage_int = 0;
+        int manage_ppc_min = -1;
+        int manage_ppc_max = -1;
+        int shape_benchmark = 0;
+        Vector<int> shape_benchmark_ppc {4, 16, 64, 100};
         Real stop_time = 1000.0;
         int max_step = 100;
         int plot_int  = 1;
@@ -111,6 +135,7 @@ int main (int argc, char* argv[])
         int write_initial_phi  = 0;
         int write_eb_geom      = 1;
         int use_hypre  = 0;
+        int mac_warm_start = 1;
         Real phi_cutoff = 0.1;
         Real cfl = 0.7;
 
@@ -123,10 +148,25 @@ int main (int argc, char* argv[])
             pp.query("max_grid_size", max_grid_size);
             pp.query("n_ppc", n_ppc);
             pp.query("pic_interpolation", pic_interpolation);
+            pp.query("deposit_mode", deposit_mode);
+            pp.query("deposit_benchmark", deposit_benchmark);
+            pp.queryarr("deposit_benchmark_ppc", deposit_benchmark_ppc);
+            pp.query("sort_displacement", sort_displacement);
+            pp.query("redistribute_margin", redistribute_margin);
+            pp.query("seeding", seeding);
+            pp.query("seeding_benchmark", seeding_benchmark);
+            pp.queryarr("seeding_benchmark_ppc", seeding_benchmark_ppc);
+            pp.query("seeding_benchmark_target", seeding_benchmark_target);
+            pp.query("manage_int", manage_int);
+            pp.query("manage_ppc_min", manage_ppc_min);
+            pp.query("manage_ppc_max", manage_ppc_max);
+            pp.query("shape_benchmark", shape_benchmark);
+            pp.queryarr("shape_benchmark_ppc", shape_benchmark_ppc);
             pp.query("stop_time", stop_time);
             pp.query("max_step", max_step);
             pp.query("plot_int", plot_int);
             pp.query("use_hypre", use_hypre);
+            pp.query("mac_warm_start", mac_warm_start);
             pp.query("write_ascii", write_ascii);
             pp.query("write_initial_phi", write_initial_phi);
             pp.query("write_eb_geom", write_eb_geom);
@@ -139,6 +179,17 @@ int main (int argc, char* argv[])
            amrex::Abort("Cant use hypre if we dont build with USE_HYPRE=TRUE");
 #endif
 
+        if (pic_interpolation < Interpolation::NGP || pic_interpolation > Interpolation::QSP)
+           amrex::Abort("pic_interpolation must be 0 (NGP), 1 (CIC), 2 (TSC) or 3 (QSP)");
+
+        if (seeding < Seeding::Random || seeding > Seeding::Jittered)
+           amrex::Abort("seeding must be 0 (random), 1 (Halton) or 2 (jittered)");
+
+        if (manage_ppc_min < 0) manage_ppc_min = std::max(1, n_ppc/2);
+        if (manage_ppc_max < 0) manage_ppc_max = 2*n_ppc;
+        if (manage_int > 0 && (manage_ppc_min < 1 || manage_ppc_min > manage_ppc_max))
+           amrex::Abort("need 1 <= manage_ppc_min <= manage_ppc_max");
+
         if (n_cell%8 != 0)
            amrex::Abort("n_cell must be a multiple of 8");
 
@@ -201,20 +252,34 @@ int main (int argc, char* argv[])
         make_eb_cylinder(geom);
         eb_stop_time = amrex::second() - eb_strt_time;
 
+        // particles may stay up to redistribute_margin cells outside their grid, so the
+        // velocity and phi need that many more ghost cells (and the EB data with them)
+        redistribute_margin = std::max(redistribute_margin, 0);
+        for (int i = 0; i < grids.size(); ++i) {
+            if (redistribute_margin >= grids[i].shortside())
+               amrex::Abort("redistribute_margin must be smaller than the smallest grid");
+        }
+
         std::unique_ptr<amrex::FabFactory<amrex::FArrayBox> > factory =
-           makeEBFabFactory(geom, grids, dmap, {4, 4, 2}, EBSupport::full);
+           makeEBFabFactory(geom, grids, dmap, {4+redistribute_margin, 4+redistribute_margin, 2+redistribute_margin},
+                            EBSupport::full);
         const EBFArrayBoxFactory* ebfact = &(static_cast<amrex::EBFArrayBoxFactory const&>(*factory));
 
         // Velocities are face-centered
         for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
-            vel[idim].define (amrex::convert(grids,IntVect::TheDimensionVector(idim)), dmap, 1, 1, MFInfo(), *factory);
+            vel[idim].define (amrex::convert(grids,IntVect::TheDimensionVector(idim)), dmap, 1, 1+redistribute_margin, MFInfo(), *factory);
         }
 
         // store plotfile variables; velocity, processor id, and phi (the EB writer appends volfrac)
         plotfile_mf.define(grids, dmap, AMREX_SPACEDIM+2, 0, MFInfo(), *factory);
         
-        // make a separate phi MultiFab for the particle-mesh operations because we need a ghost cell
-        phi_mf.define(grids, dmap, 1, 1, MFInfo(), *factory);
+        // make a separate phi MultiFab for the particle-mesh operations because we need ghost cells,
+        // as many as the particle shape reaches (the widest shape for the shape benchmark)
+        // beyond the redistribute margin
+        int phi_nghost = std::max(1, shape_halfwidth(pic_interpolation));
+        if (shape_benchmark > 0) phi_nghost = std::max(phi_nghost, shape_halfwidth(Interpolation::QSP));
+        phi_nghost += redistribute_margin;
+        phi_mf.define(grids, dmap, 1, phi_nghost, MFInfo(), *factory);
 
         // Get volume fraction for the embedded geometry
         // volume fraction = 0 for cells covered by the embedded geometry
@@ -263,15 +328,32 @@ int main (int argc, char* argv[])
             WriteSingleLevelPlotfile(pfname, phi_mf, {"phi"}, geom, 0.0, 0);
         }
 
+        if (deposit_benchmark > 0) {
+            benchmark_deposit(geom, dmap, grids, phi_mf, vol_mf, phi_cutoff,
+                              deposit_benchmark_ppc, pic_interpolation, deposit_benchmark);
+        }
+
+        if (shape_benchmark > 0) {
+            benchmark_shapes(geom, dmap, grids, phi_mf, vol_mf, phi_cutoff,
+                             shape_benchmark_ppc, deposit_mode, shape_benchmark);
+        }
+
+        if (seeding_benchmark > 0) {
+            benchmark_seeding(geom, dmap, grids, phi_mf, vol_mf, phi_cutoff, seeding_benchmark_ppc,
+                              pic_interpolation, deposit_mode, seeding_benchmark, seeding_benchmark_target);
+        }
+
         // Initialize Particles
         FluidParticleContainer FPC(geom, dmap, grids);
+        FPC.SetSortDisplacement(sort_displacement);
+        FPC.SetRedistributeMargin(redistribute_margin);
 
-        // Initialize n_ppc randomly located particles per cell.
+        // Initialize n_ppc particles per cell, located as the seeding says.
         // Particles are weighted by interpolated density field phi.
         // Only creates particles in regions not covered by the embedded geometry.
-        FPC.InitParticles(phi_mf, vol_mf, phi_cutoff, n_ppc, pic_interpolation);
+        FPC.InitParticles(phi_mf, vol_mf, phi_cutoff, n_ppc, pic_interpolation, seeding);
 
-        FPC.DepositToMesh(phi_mf, pic_interpolation);
+        FPC.DepositToMesh(phi_mf, pic_interpolation, deposit_mode);
         EB_set_covered(phi_mf,-1.0);
 
         if (write_initial_phi) {
@@ -298,7 +380,7 @@ int main (int argc, char* argv[])
         {
             amrex::Print() << "Creating the initial velocity field " << std::endl;
             define_velocity(time,geom,vel,phi_mf);
-            mac_project_velocity(vel,geom,use_hypre);
+            mac_project_velocity(vel,geom,use_hypre,mac_warm_start);
             EB_average_face_to_cellcenter(plotfile_mf,0,amrex::GetArrOfConstPtrs(vel));
 
             // copy initial deposited phi into the plotfile
@@ -326,12 +408,14 @@ int main (int argc, char* argv[])
                 amrex::Print() << "STEP " << i+1 << " starts at TIME = " << time
                                << " DT = " << dt << std::endl;
 
+                const Real step_strt_time = amrex::second();
+
                 dt = amrex::min(dt, stop_time - time);
 
                 Real t_nph = time + 0.5 * dt;
 
                 define_velocity(t_nph,geom,vel,phi_mf);
-                mac_project_velocity(vel,geom,use_hypre);
+                mac_project_velocity(vel,geom,use_hypre,mac_warm_start);
 
                 for (int idim = 0; idim < AMREX_SPACEDIM; ++idim) {
                     vel[idim].FillBoundary(geom.periodicity());
@@ -340,11 +424,20 @@ int main (int argc, char* argv[])
                 // Step Particles
                 FPC.AdvectWithUmac(vel.data(), 0, dt);
 
-                // Redistribute Particles across MPI ranks with their new positions
-                FPC.Redistribute();
+                // Redistribute Particles across MPI ranks with their new positions,
+                // once they have left their grids by more than the margin
+                FPC.RedistributeIfDisplaced();
+
+                // Merge and split particles to hold the particles per cell between the bounds
+                if (manage_int > 0 && (i+1)%manage_int == 0) {
+                    FPC.ManageParticles(manage_ppc_min, manage_ppc_max);
+                }
+
+                // Sort the particles by cell again once they have moved far enough
+                FPC.SortIfDisplaced();
 
                 // Deposit Particles to the grid to update phi
-                FPC.DepositToMesh(phi_mf, pic_interpolation);
+                FPC.DepositToMesh(phi_mf, pic_interpolation, deposit_mode);
                 EB_set_covered(phi_mf,-1.0);
 
                 // Increment time
@@ -367,7 +460,15 @@ int main (int argc, char* argv[])
                 sum_phi = FPC.SumPhi();
 
                 amrex::Print() << "STEP " << i+1 << " ends   at TIME = " << time
-                               << " DT = " << dt << " Sum(Phi) = " << sum_phi << "\n" << std::endl;
+                               << " DT = " << dt << " Sum(Phi) = " << sum_phi << std::endl;
+
+                if (manage_int > 0) {
+                    Real step_time = amrex::second() - step_strt_time;
+                    ParallelDescriptor::ReduceRealMax(step_time);
+                    amrex::Print() << "STEP " << i+1 << " particles = " << FPC.TotalNumberOfParticles()
+                                   << " step time = " << step_time << std::endl;
+                }
+                amrex::Print() << std::endl;
 
                 // Compute lagged dt for next time step based on this half-time velocity
                 dt = est_time_step(dt, geom, vel, cfl);
@@ -382,6 +483,27 @@ int main (int argc, char* argv[])
                 break;
             }
         }
+
+        if (redistribute_margin > 0) {
+            amrex::Print() << "\nRedistributed the particles " << FPC.NumRedistributes() << " times in "
+                           << nstep << " steps" << std::endl;
+        }
+
+        if (manage_int > 0) {
+            Long nmerged = FPC.NumMerged();
+            Long nsplit = FPC.NumSplit();
+            ParallelDescriptor::ReduceLongSum(nmerged);
+            ParallelDescriptor::ReduceLongSum(nsplit);
+            amrex::Print() << "\nMerged " << nmerged << " and split " << nsplit << " particles to hold "
+                           << manage_ppc_min << " to " << manage_ppc_max << " particles per cell" << std::endl;
+        }
+
+        if (sort_displacement > 0.0) {
+            amrex::Print() << "\nSorted the particles by cell " << FPC.NumSorts() << " times" << std::endl;
+        }
+
+        FPC.PrintKernelStats();
+        print_mac_projection_stats();
     }
 
     Real stop_time = amrex::second() - strt_time;